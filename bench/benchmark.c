@@ -0,0 +1,409 @@
+#include "config.h"
+#include "joybus.h"
+#include "stick.h"
+#include "encoder.h"
+#include "buttons.h"
+#include "controller_pak.h"
+#include "n64_protocol.h"
+#include "checksum_baseline.h"
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include <stdio.h>
+
+#if PICO_ON_DEVICE
+#include "pico/stdio_usb.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+#else
+#include <time.h>
+#include "mock_hal.h"
+#endif
+
+// Microbenchmarks for the kernels on the reply and input paths
+//
+// Every kernel runs in batches of a fixed number of calls. The suite prints
+// one CSV row per kernel with the cost per call of the fastest and the
+// median batch: core clock cycles from SysTick on the RP2040, nanoseconds
+// on a host (where the SDK is replaced by the mock HAL in bench/mock).
+
+#if PICO_ON_DEVICE
+#define BENCH_PLATFORM "rp2040"
+#define BENCH_UNIT "cycles"
+#define BENCH_ITERATIONS 1000   // A batch has to stay under 2^24 cycles
+
+// SysTick counts clk_sys cycles down from 2^24 - 1
+#define BENCH_SYSTICK_MASK 0x00FFFFFFu
+
+static inline uint32_t bench_clock(void) {
+    return systick_hw->cvr;
+}
+
+static inline uint32_t bench_elapsed(uint32_t start, uint32_t end) {
+    return (start - end) & BENCH_SYSTICK_MASK;
+}
+#else
+#define BENCH_PLATFORM "host"
+#define BENCH_UNIT "ns"
+#define BENCH_ITERATIONS 10000
+
+static inline uint32_t bench_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000000u + (uint32_t)now.tv_nsec;
+}
+
+static inline uint32_t bench_elapsed(uint32_t start, uint32_t end) {
+    return end - start;
+}
+#endif
+
+#define BENCH_BATCHES 31
+
+// The pak's dirty page queue holds 64 pages until core 0 drains it
+#define BENCH_PAK_WRITES 32
+#define BENCH_PAK_WRITE_PAGES 16
+
+typedef struct {
+    const char* name;
+    void (*setup)(void);            // Before every batch, not timed (optional)
+    void (*run)(uint32_t iterations);
+    uint32_t max_iterations;        // Batch size limit (0: BENCH_ITERATIONS)
+} bench_kernel_t;
+
+// Results go here so the calls can't be optimized away
+static volatile uint32_t bench_sink;
+
+static uint8_t bench_block[CONTROLLER_PAK_PAGE_SIZE + 1];
+static uint32_t bench_frame[JOYBUS_TX_FRAME_WORDS(CONTROLLER_PAK_PAGE_SIZE + 1)];
+
+// controller_pak_task asks before touching flash; the benchmark never saves
+bool n64_protocol_idle_window(uint32_t duration_us) {
+    return false;
+}
+
+// Flash work parks core 1, which the benchmark never starts
+void n64_protocol_park_begin(void) {
+}
+
+void n64_protocol_park_end(void) {
+}
+
+// Kernels
+
+static void bench_loop_overhead(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        __asm volatile ("");
+    }
+}
+
+static void bench_calculate_crc(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += calculate_crc(bench_block, CONTROLLER_PAK_PAGE_SIZE);
+    }
+    bench_sink = sum;
+}
+
+static void bench_calculate_address_checksum(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += calculate_address_checksum((uint16_t)(i * CONTROLLER_PAK_PAGE_SIZE));
+    }
+    bench_sink = sum;
+}
+
+static void bench_calculate_crc_bitwise(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += bench_crc_bitwise(bench_block, CONTROLLER_PAK_PAGE_SIZE);
+    }
+    bench_sink = sum;
+}
+
+static void bench_calculate_address_checksum_bitwise(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += bench_address_checksum_bitwise((uint16_t)(i * CONTROLLER_PAK_PAGE_SIZE));
+    }
+    bench_sink = sum;
+}
+
+// Tables and baseline must agree before their timings mean anything
+static bool bench_check_checksums(void) {
+    for (uint32_t address = 0; address <= 0xFFFF; address += CONTROLLER_PAK_PAGE_SIZE) {
+        if (calculate_address_checksum((uint16_t)address) != bench_address_checksum_bitwise((uint16_t)address)) {
+            printf("# calculate_address_checksum mismatch at 0x%04lx\n", (unsigned long)address);
+            return false;
+        }
+    }
+    for (size_t length = 0; length <= CONTROLLER_PAK_PAGE_SIZE; length++) {
+        if (calculate_crc(bench_block, length) != bench_crc_bitwise(bench_block, length)) {
+            printf("# calculate_crc mismatch at length %u\n", (unsigned)length);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_joybus_encode_poll_reply(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += joybus_encode_poll_reply(i * 0x9E3779B1u);
+    }
+    bench_sink = sum;
+}
+
+static void bench_joybus_pack_response(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += joybus_pack_response(bench_frame, bench_block, sizeof(bench_block));
+    }
+    bench_sink = sum;
+}
+
+static void bench_stick_map(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        int8_t x, y;
+        // Sweep past both ends of the calibration range
+        stick_map((int32_t)(i % 161) - 80, (int32_t)(i * 7 % 161) - 80, &x, &y);
+        sum += (uint8_t)x + (uint8_t)y;
+    }
+    bench_sink = sum;
+}
+
+static void bench_encoder_get_stick(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        int8_t x, y;
+        encoder_get_stick(&x, &y);
+        sum += (uint8_t)x + (uint8_t)y;
+    }
+    bench_sink = sum;
+}
+
+#if !PICO_ON_DEVICE
+// Mock time, moved on by the encoder setups
+static uint32_t bench_batch_us = 0;
+
+// Stick at rest: the last edges are long past
+static void bench_encoder_still_setup(void) {
+    bench_batch_us += 1000000;
+    mock_time_set_us(bench_batch_us);
+}
+
+// Stick moving: a fresh run of edges on both axes 1ms apart, polled between
+// two of them, so every read extrapolates
+static void bench_encoder_moving_setup(void) {
+    static uint32_t count = 0;
+    
+    for (uint32_t edge = 0; edge <= ENCODER_VELOCITY_EDGES; edge++) {
+        bench_batch_us += 1000;
+        mock_time_set_us(bench_batch_us);
+        count--;    // The decoder counts down in our positive direction
+        mock_pio_push(ENCODER_PIO, ENCODER_X_PIO_SM, count);
+        mock_pio_push(ENCODER_PIO, ENCODER_Y_PIO_SM, count);
+    }
+    mock_time_set_us(bench_batch_us + 400);
+}
+#endif
+
+static void bench_buttons_read_raw(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += buttons_read_raw();
+    }
+    bench_sink = sum;
+}
+
+static void bench_buttons_read(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += buttons_read();
+    }
+    bench_sink = sum;
+}
+
+#if !PICO_ON_DEVICE
+// A and Z held (active low)
+static void bench_buttons_setup(void) {
+    mock_gpio_set_all(~((1u << BUTTON_A_PIN) | (1u << BUTTON_Z_PIN)));
+}
+#endif
+
+static void bench_controller_pak_read(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        // Walk the whole pak, as a game loading a save would
+        controller_pak_read(0, (uint16_t)(i * CONTROLLER_PAK_PAGE_SIZE % CONTROLLER_PAK_SIZE),
+                            bench_block, CONTROLLER_PAK_PAGE_SIZE);
+        sum += bench_block[0];
+    }
+    bench_sink = sum;
+}
+
+static void bench_controller_pak_read_crc(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += controller_pak_read_crc(0, (uint16_t)(i * CONTROLLER_PAK_PAGE_SIZE % CONTROLLER_PAK_SIZE));
+    }
+    bench_sink = sum;
+}
+
+// Hand the queued pages to core 0's side (nothing is saved, see
+// n64_protocol_idle_window above) so every write takes the normal path
+static void bench_controller_pak_write_setup(void) {
+    controller_pak_task();
+}
+
+static void bench_controller_pak_write(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench_block[0] = (uint8_t)i;
+        sum += controller_pak_write(0, (uint16_t)(i % BENCH_PAK_WRITE_PAGES * CONTROLLER_PAK_PAGE_SIZE),
+                                    bench_block, CONTROLLER_PAK_PAGE_SIZE);
+    }
+    bench_sink = sum;
+}
+
+// Row names are stable: compare runs by kernel
+static const bench_kernel_t bench_kernels[] = {
+    { "loop_overhead", NULL, bench_loop_overhead, 0 },
+    { "calculate_crc", NULL, bench_calculate_crc, 0 },
+    { "calculate_address_checksum", NULL, bench_calculate_address_checksum, 0 },
+    { "calculate_crc_bitwise", NULL, bench_calculate_crc_bitwise, 0 },
+    { "calculate_address_checksum_bitwise", NULL, bench_calculate_address_checksum_bitwise, 0 },
+    { "joybus_encode_poll_reply", NULL, bench_joybus_encode_poll_reply, 0 },
+    { "joybus_pack_response", NULL, bench_joybus_pack_response, 0 },
+    { "stick_map", NULL, bench_stick_map, 0 },
+#if PICO_ON_DEVICE
+    // Whatever the stick is doing; leave it alone for the still figure
+    { "encoder_get_stick", NULL, bench_encoder_get_stick, 0 },
+#else
+    { "encoder_get_stick", bench_encoder_still_setup, bench_encoder_get_stick, 0 },
+    { "encoder_get_stick_moving", bench_encoder_moving_setup, bench_encoder_get_stick, 0 },
+#endif
+#if PICO_ON_DEVICE
+    { "buttons_read_raw", NULL, bench_buttons_read_raw, 0 },
+    { "buttons_read", NULL, bench_buttons_read, 0 },
+#else
+    { "buttons_read_raw", bench_buttons_setup, bench_buttons_read_raw, 0 },
+    { "buttons_read", bench_buttons_setup, bench_buttons_read, 0 },
+#endif
+    { "controller_pak_read", NULL, bench_controller_pak_read, 0 },
+    { "controller_pak_read_crc", NULL, bench_controller_pak_read_crc, 0 },
+    { "controller_pak_write", bench_controller_pak_write_setup, bench_controller_pak_write, BENCH_PAK_WRITES },
+};
+
+#define BENCH_KERNEL_COUNT (sizeof(bench_kernels) / sizeof(bench_kernels[0]))
+
+// Runner
+
+static uint32_t bench_batch(const bench_kernel_t* kernel, uint32_t iterations) {
+    if (kernel->setup) {
+        kernel->setup();
+    }
+    
+#if PICO_ON_DEVICE
+    // Nothing else on the core while the batch runs (USB included)
+    uint32_t interrupts = save_and_disable_interrupts();
+#endif
+    uint32_t start = bench_clock();
+    kernel->run(iterations);
+    uint32_t end = bench_clock();
+#if PICO_ON_DEVICE
+    restore_interrupts(interrupts);
+#endif
+    
+    return bench_elapsed(start, end);
+}
+
+static void bench_sort(uint32_t* values, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        uint32_t value = values[i];
+        size_t j = i;
+        for (; j > 0 && values[j - 1] > value; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+}
+
+// Per-call cost with two decimals, without floating point
+static void bench_print_per_call(uint32_t total, uint32_t iterations) {
+    uint64_t hundredths = (uint64_t)total * 100 / iterations;
+    printf("%lu.%02lu", (unsigned long)(hundredths / 100), (unsigned long)(hundredths % 100));
+}
+
+static void bench_run_all(void) {
+    if (!bench_check_checksums()) {
+        return;
+    }
+    printf("platform,kernel,unit,iterations,batches,min,median\n");
+    
+    for (size_t k = 0; k < BENCH_KERNEL_COUNT; k++) {
+        const bench_kernel_t* kernel = &bench_kernels[k];
+        uint32_t iterations = kernel->max_iterations ? kernel->max_iterations : BENCH_ITERATIONS;
+        uint32_t samples[BENCH_BATCHES];
+    
+        // One untimed batch first: caches, overlay slots and lazy state
+        bench_batch(kernel, iterations);
+        for (uint32_t batch = 0; batch < BENCH_BATCHES; batch++) {
+            samples[batch] = bench_batch(kernel, iterations);
+        }
+        bench_sort(samples, BENCH_BATCHES);
+    
+        printf("%s,%s,%s,%lu,%u,", BENCH_PLATFORM, kernel->name, BENCH_UNIT,
+               (unsigned long)iterations, BENCH_BATCHES);
+        bench_print_per_call(samples[0], iterations);
+        printf(",");
+        bench_print_per_call(samples[BENCH_BATCHES / 2], iterations);
+        printf("\n");
+    }
+}
+
+static void bench_init(void) {
+#if PICO_ON_DEVICE
+    stdio_usb_init();
+    
+    // Free-running cycle counter (no interrupt)
+    systick_hw->rvr = BENCH_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+#else
+    mock_hal_init();
+#endif
+    
+    // The real modules, set up as the firmware does. On the RP2040 the pak
+    // gets a flash region of its own (FLASH_STORAGE_OFFSET in CMakeLists.txt):
+    // controller_pak_init() may format or migrate whatever it finds there, and
+    // must never do that to the firmware's saves.
+    encoder_init();
+    encoder_set_center();
+    buttons_init();
+    controller_pak_init();
+    
+    for (size_t i = 0; i < sizeof(bench_block); i++) {
+        bench_block[i] = (uint8_t)(i * 37 + 11);
+    }
+}
+
+int main(void) {
+    bench_init();
+    
+#if PICO_ON_DEVICE
+    // Run once a terminal is attached, then again on every key press
+    while (true) {
+        while (!stdio_usb_connected()) {
+            sleep_ms(100);
+        }
+        bench_run_all();
+    
+        while (stdio_usb_connected() && getchar_timeout_us(100000) == PICO_ERROR_TIMEOUT) {
+        }
+    }
+#else
+    bench_run_all();
+    return 0;
+#endif
+}
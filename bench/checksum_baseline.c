@@ -0,0 +1,32 @@
+#include "checksum_baseline.h"
+#include "joybus.h"
+
+// Same placement as the table versions, so only the algorithm differs
+uint8_t JOYBUS_RAM_FUNC(bench_crc_bitwise)(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            if (crc & 0x80) {
+                crc = (crc << 1) ^ 0x85;  // N64 CRC polynomial
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+uint8_t JOYBUS_RAM_FUNC(bench_address_checksum_bitwise)(uint16_t address) {
+    static const uint8_t checksum_table[] = {
+        0x01, 0x1A, 0x0D, 0x1C, 0x0E, 0x07, 0x19, 0x16, 0x0B, 0x1F, 0x15
+    };
+    
+    uint8_t checksum = 0;
+    for (int i = 10; i >= 0; i--) {
+        if (address & (1 << (15 - i))) {
+            checksum ^= checksum_table[i];
+        }
+    }
+    return checksum;
+}
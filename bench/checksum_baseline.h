@@ -0,0 +1,15 @@
+#ifndef CHECKSUM_BASELINE_H
+#define CHECKSUM_BASELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The bit-by-bit Joybus checksums that the lookup tables in joybus.c replaced.
+// They stay in their own file so the compiler can't hoist them out of the
+// benchmark loop, just as it can't for calculate_crc.
+
+// Function prototypes
+uint8_t bench_crc_bitwise(const uint8_t* data, size_t length);
+uint8_t bench_address_checksum_bitwise(uint16_t address);
+
+#endif // CHECKSUM_BASELINE_H
@@ -0,0 +1,551 @@
+#include "config.h"
+#include "n64_protocol.h"
+#include "n64_protocol.pio.h"
+#include "controller_pak.h"
+#include "event_log.h"
+#include "buttons.h"
+#include "joybus.h"
+#include "checksum_baseline.h"
+#include "mock_hal.h"
+#include "hardware/pio.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Virtual console for the Joybus responder
+//
+// n64_protocol.c runs here as it does on core 1, against the mock HAL. The
+// console side plays the PIO: a command frame is pushed into the port's RX
+// FIFO byte by byte, the mock DMA carries it into the firmware's frame buffer,
+// and the frame flag goes up while core 1 waits in WFE. The words the firmware
+// hands the state machine are decoded back into the reply.
+//
+// Simulated time follows the Joybus bit rate, so the frame and reply edges the
+// firmware derives can be checked exactly. Reply latency is measured by the
+// firmware itself, against a SysTick counting clk_sys cycles of host time.
+// Reply bytes and CRCs are checked against the bit-by-bit checksums in
+// checksum_baseline.c. Every mismatch is printed and fails the run.
+
+#define SIM_GAP_US 20               // Console pause between a reply and the next command
+#define SIM_POLL_PERIOD_US 16667    // One poll per port every 60Hz frame
+#define SIM_SAVE_FRAMES 600         // Frames a pak save may take while the console polls
+#define SIM_TASK_STEP_US 1000       // Core 0 loop interval between polls
+
+typedef struct {
+    bool answered;
+    size_t length;
+    uint8_t data[N64_MAX_RESPONSE_LENGTH];
+} sim_reply_t;
+
+static uint32_t sim_now_us = 1000;
+static int sim_failures = 0;
+static const char* sim_test = "";
+
+// Replies per command class, to hold the latency histograms against
+static uint32_t sim_answered[N64_COMMAND_CLASS_COUNT];
+
+// Frame the console sends as soon as core 1 waits for one
+static const uint8_t* sim_frame = NULL;
+static size_t sim_frame_length = 0;
+static uint8_t sim_frame_port = 0;
+static uint32_t sim_park_us = 0;    // Core 0 holds core 1 parked this long around the frame
+static jmp_buf sim_stuck;
+
+static void sim_fail(const char* format, ...) {
+    va_list args;
+    
+    printf("FAIL %s: ", sim_test);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    sim_failures++;
+}
+
+#define SIM_CHECK(condition, ...) do { if (!(condition)) sim_fail(__VA_ARGS__); } while (0)
+
+static n64_command_class_t sim_command_class(uint8_t command) {
+    switch (command) {
+        case N64_CMD_INFO:  return N64_COMMAND_CLASS_INFO;
+        case N64_CMD_POLL:  return N64_COMMAND_CLASS_POLL;
+        case N64_CMD_READ:  return N64_COMMAND_CLASS_READ;
+        case N64_CMD_WRITE: return N64_COMMAND_CLASS_WRITE;
+        case N64_CMD_RESET: return N64_COMMAND_CLASS_RESET;
+        default:            return N64_COMMAND_CLASS_OTHER;
+    }
+}
+
+static const char* const sim_class_names[N64_COMMAND_CLASS_COUNT] = {
+    "info", "poll", "read", "write", "reset", "other"
+};
+
+// Console side
+
+// Core 1 sleeps in WFE until a frame is flagged: put the pending one on the
+// wire. A second wait for the same transaction means the frame was lost.
+static void sim_console_wfe(void) {
+    if (!sim_frame) {
+        sim_fail("core 1 went back to sleep without answering port %u", sim_frame_port);
+        longjmp(sim_stuck, 1);
+    }
+    
+    if (sim_park_us) {
+        n64_protocol_park_begin();
+    }
+    for (size_t i = 0; i < sim_frame_length; i++) {
+        mock_pio_push(N64_PIO, sim_frame_port, sim_frame[i]);
+    }
+    sim_frame = NULL;
+    
+    // The state machine flags the frame once the line has been idle for
+    // IDLE_US after the stop bit, unless it stalled on a full FIFO first
+    sim_now_us += sim_frame_length * 8 * N64_BIT_PERIOD_US + N64_STOP_CONSOLE_LOW_US + n64_port_IDLE_US;
+    mock_time_set_us(sim_now_us);
+    if (!(N64_PIO->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + sim_frame_port)))) {
+        N64_PIO->irq |= 1u << (n64_port_FRAME_IRQ + sim_frame_port);
+    }
+    
+    // Core 1 only sees the flag once core 0 lets it go
+    if (sim_park_us) {
+        sim_now_us += sim_park_us;
+        mock_time_set_us(sim_now_us);
+        n64_protocol_park_end();
+    }
+}
+
+// Send a command frame to a port, let core 1 answer it and decode what it
+// handed the state machine. False if the firmware broke the protocol.
+static bool sim_transact(uint8_t port, const uint8_t* frame, size_t length, sim_reply_t* reply) {
+    uint32_t frame_start_us = sim_now_us;
+    uint32_t words[JOYBUS_TX_FRAME_WORDS(N64_MAX_RESPONSE_LENGTH) + 1];
+    
+    memset(reply, 0, sizeof(*reply));
+    mock_time_set_us(sim_now_us);
+    sim_frame = frame;
+    sim_frame_length = length;
+    sim_frame_port = port;
+    
+    if (setjmp(sim_stuck)) {
+        N64_PIO->irq = 0;
+        mock_pio_pull(N64_PIO, port, words, 0);
+        return false;
+    }
+    n64_protocol_task();
+    uint32_t wake_us = sim_now_us;
+    
+    if (N64_PIO->irq & (1u << (n64_port_FRAME_IRQ + port))) {
+        sim_fail("frame flag of port %u left set", port);
+    }
+    
+    // First word: bit count minus one, or 0 to go back to listening
+    size_t count = mock_pio_pull(N64_PIO, port, words, sizeof(words) / sizeof(words[0]));
+    if (count == 0) {
+        sim_fail("port %u left waiting for its reply", port);
+        return false;
+    }
+    if (words[0] == 0) {
+        SIM_CHECK(count == 1, "%zu words after a no-reply word", count - 1);
+        sim_now_us = wake_us + SIM_GAP_US;
+        return count == 1;
+    }
+    
+    uint32_t bits = words[0] + 1;
+    if (bits % 8 != 0 || bits / 8 > N64_MAX_RESPONSE_LENGTH || count != JOYBUS_TX_FRAME_WORDS(bits / 8)) {
+        sim_fail("malformed TX frame: %lu bits in %zu words", (unsigned long)bits, count);
+        return false;
+    }
+    reply->answered = true;
+    reply->length = bits / 8;
+    for (size_t i = 0; i < reply->length; i++) {
+        reply->data[i] = (uint8_t)(words[1 + i / 4] >> (24 - 8 * (i % 4)));
+    }
+    
+    // Edges the firmware derived from its own timestamps
+    n64_protocol_stats_t stats;
+    n64_protocol_get_stats(port, &stats);
+    SIM_CHECK(stats.last_command == frame[0], "last command 0x%02lx, sent 0x%02x",
+              (unsigned long)stats.last_command, frame[0]);
+    SIM_CHECK(stats.frame_start_us == frame_start_us, "frame start %lu us, sent at %lu us",
+              (unsigned long)stats.frame_start_us, (unsigned long)frame_start_us);
+    SIM_CHECK((int32_t)(stats.reply_start_us - wake_us) >= 0, "reply starts before the frame was flagged");
+    SIM_CHECK(stats.reply_end_us - stats.reply_start_us ==
+              bits * N64_BIT_PERIOD_US + N64_STOP_CONTROLLER_LOW_US + N64_STOP_CONTROLLER_HIGH_US,
+              "reply of %lu bits lasts %lu us", (unsigned long)bits,
+              (unsigned long)(stats.reply_end_us - stats.reply_start_us));
+    
+    sim_answered[sim_command_class(frame[0])]++;
+    sim_now_us = stats.reply_end_us + SIM_GAP_US;
+    return true;
+}
+
+static void sim_print_bytes(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        printf(" %02x", data[i]);
+    }
+    printf("\n");
+}
+
+// Send a frame and compare the reply with the expected bytes (NULL: no reply)
+static void sim_expect(uint8_t port, const uint8_t* frame, size_t length, const uint8_t* expected, size_t expected_length) {
+    sim_reply_t reply;
+    if (!sim_transact(port, frame, length, &reply)) {
+        return;
+    }
+    
+    if (!expected) {
+        SIM_CHECK(!reply.answered, "port %u answered command 0x%02x (%zu bytes), expected silence",
+                  port, frame[0], length);
+        return;
+    }
+    if (!reply.answered || reply.length != expected_length || memcmp(reply.data, expected, expected_length) != 0) {
+        sim_fail("port %u, command 0x%02x (%zu bytes): reply differs", port, frame[0], length);
+        printf("  expected:");
+        sim_print_bytes(expected, expected_length);
+        printf("  got:     ");
+        sim_print_bytes(reply.data, reply.answered ? reply.length : 0);
+    }
+}
+
+// READ (data NULL) or WRITE frame for an address, with its address checksum
+// or a corrupted one. Returns the frame length.
+static size_t sim_pak_frame(uint8_t* frame, uint16_t address, bool valid, const uint8_t* data) {
+    uint16_t word = address | (bench_address_checksum_bitwise(address) ^ (valid ? 0 : 0x01));
+    
+    frame[0] = data ? N64_CMD_WRITE : N64_CMD_READ;
+    frame[1] = (uint8_t)(word >> 8);
+    frame[2] = (uint8_t)word;
+    if (!data) {
+        return N64_CMD_READ_LENGTH;
+    }
+    memcpy(&frame[3], data, CONTROLLER_PAK_PAGE_SIZE);
+    return N64_CMD_WRITE_LENGTH;
+}
+
+static void sim_expect_info(uint8_t port, uint8_t command, uint8_t status) {
+    uint8_t expected[N64_INFO_RESPONSE_LENGTH] = { N64_CONTROLLER_ID_HIGH, N64_CONTROLLER_ID_LOW, status };
+    sim_expect(port, &command, 1, expected, sizeof(expected));
+}
+
+static void sim_expect_write(uint8_t port, uint16_t address, bool valid, const uint8_t* data, uint8_t crc) {
+    uint8_t frame[N64_CMD_WRITE_LENGTH];
+    size_t length = sim_pak_frame(frame, address, valid, data);
+    sim_expect(port, frame, length, &crc, N64_WRITE_RESPONSE_LENGTH);
+}
+
+static void sim_expect_read(uint8_t port, uint16_t address, bool valid, const uint8_t* data, uint8_t crc) {
+    uint8_t frame[N64_CMD_READ_LENGTH];
+    uint8_t expected[N64_READ_RESPONSE_LENGTH];
+    
+    memcpy(expected, data, CONTROLLER_PAK_PAGE_SIZE);
+    expected[CONTROLLER_PAK_PAGE_SIZE] = crc;
+    sim_expect(port, frame, sim_pak_frame(frame, address, valid, NULL), expected, sizeof(expected));
+}
+
+static void sim_pattern(uint8_t* data, uint8_t seed) {
+    for (size_t i = 0; i < CONTROLLER_PAK_PAGE_SIZE; i++) {
+        data[i] = (uint8_t)(seed * 31 + i * 7 + 1);
+    }
+}
+
+static n64_protocol_stats_t sim_stats(uint8_t port) {
+    n64_protocol_stats_t stats;
+    n64_protocol_get_stats(port, &stats);
+    return stats;
+}
+
+// Sequences
+
+static const uint8_t sim_zeros[CONTROLLER_PAK_PAGE_SIZE];
+
+// Core 1 answers before core 0 has loaded the pak: no pak is reported and
+// writes are refused with a bad CRC
+static void sim_test_boot(void) {
+    sim_test = "boot";
+    uint8_t data[CONTROLLER_PAK_PAGE_SIZE];
+    sim_pattern(data, 0xA5);
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        sim_expect_info(port, N64_CMD_INFO, 0);
+        sim_expect_write(port, 0x0100, true, data, bench_crc_bitwise(data, sizeof(data)) ^ 0xFF);
+        sim_expect_read(port, 0x0100, true, sim_zeros, 0);
+    }
+    
+    SIM_CHECK(controller_pak_init(), "controller_pak_init failed");
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+    }
+}
+
+static void sim_test_info_reset(void) {
+    sim_test = "info/reset";
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+        sim_expect_info(port, N64_CMD_RESET, N64_STATUS_PAK_INSERTED);
+    
+        // Anything unknown is answered like INFO
+        sim_expect_info(port, 0x55, N64_STATUS_PAK_INSERTED);
+    }
+}
+
+static uint32_t sim_sampler_calls = 0;
+
+static uint32_t sim_sampler(uint8_t port) {
+    sim_sampler_calls++;
+    return 0x12345600u | port;
+}
+
+static void sim_expect_poll(uint8_t port, uint16_t buttons, int8_t x, int8_t y) {
+    uint8_t command = N64_CMD_POLL;
+    uint8_t expected[N64_POLL_RESPONSE_LENGTH] = {
+        (uint8_t)(buttons >> 8), (uint8_t)buttons, (uint8_t)x, (uint8_t)y
+    };
+    sim_expect(port, &command, 1, expected, sizeof(expected));
+}
+
+static void sim_test_poll(void) {
+    sim_test = "poll";
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        n64_controller_state_t state = { N64_BUTTON_A | N64_BUTTON_CD, (int8_t)(-5 - port), 100 };
+        n64_controller_state_t published;
+    
+        n64_protocol_update_state(port, &state);
+        sim_expect_poll(port, state.buttons, state.stick_x, state.stick_y);
+        n64_protocol_get_state(port, &published);
+        SIM_CHECK(memcmp(&published, &state, sizeof(state)) == 0, "port %u state not published as given", port);
+    
+        // L + R + Start reports the reset bit instead of Start
+        state.buttons = N64_RESET_MASK | N64_BUTTON_B;
+        state.stick_x = 127;
+        state.stick_y = -128;
+        n64_protocol_update_state(port, &state);
+        sim_expect_poll(port, (state.buttons | 0x8000) & ~N64_BUTTON_START, 127, -128);
+    
+        // The buffer published last wins, however often core 0 updates
+        for (int i = 0; i < 5; i++) {
+            state.buttons = (uint16_t)(N64_BUTTON_DU << i);
+            state.stick_x = (int8_t)i;
+            n64_protocol_update_state(port, &state);
+        }
+        sim_expect_poll(port, N64_BUTTON_DU << 4, 4, -128);
+    }
+    
+    // Just-in-time sampling on core 1, once per POLL
+    n64_protocol_set_poll_sampler(sim_sampler);
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        sim_sampler_calls = 0;
+        sim_expect_poll(port, 0x1234, 0x56, (int8_t)port);
+        SIM_CHECK(sim_sampler_calls == 1, "sampler called %lu times for one POLL", (unsigned long)sim_sampler_calls);
+    }
+    n64_protocol_set_poll_sampler(NULL);
+    sim_expect_poll(0, N64_BUTTON_DU << 4, 4, -128);
+}
+
+// Poll every port once per 60Hz frame, running core 0's pak task in the gaps,
+// until the pak has been saved
+static void sim_poll_until_saved(void) {
+    uint8_t command = N64_CMD_POLL;
+    sim_reply_t reply;
+    
+    for (int frame = 0; frame < SIM_SAVE_FRAMES; frame++) {
+        uint32_t frame_start_us = sim_now_us;
+        for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+            SIM_CHECK(sim_transact(port, &command, 1, &reply) && reply.answered, "port %u missed a POLL", port);
+        }
+    
+        while (sim_now_us - frame_start_us < SIM_POLL_PERIOD_US - SIM_TASK_STEP_US) {
+            sim_now_us += SIM_TASK_STEP_US;
+            mock_time_set_us(sim_now_us);
+            controller_pak_task();
+        }
+        sim_now_us = frame_start_us + SIM_POLL_PERIOD_US;
+    
+        if (!controller_pak_save_pending()) {
+            return;
+        }
+    }
+    sim_fail("pak not saved after %d frames of polling", SIM_SAVE_FRAMES);
+}
+
+static void sim_test_pak(void) {
+    sim_test = "pak";
+    uint8_t data[CONTROLLER_PAK_PAGE_SIZE];
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        sim_pattern(data, port);
+        sim_expect_write(port, 0x0120, true, data, bench_crc_bitwise(data, sizeof(data)));
+        sim_expect_read(port, 0x0120, true, data, bench_crc_bitwise(data, sizeof(data)));
+        sim_pattern(data, (uint8_t)(port + 0x40));
+        sim_expect_write(port, 0x7FE0, true, data, bench_crc_bitwise(data, sizeof(data)));
+    
+        // Accessory space above the pak reads as zeros
+        sim_expect_read(port, 0x8000, true, sim_zeros, 0);
+    }
+    
+    // Each port kept its own data, in RAM and then in flash
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+            sim_pattern(data, port);
+            sim_expect_read(port, 0x0120, true, data, bench_crc_bitwise(data, sizeof(data)));
+            sim_pattern(data, (uint8_t)(port + 0x40));
+            sim_expect_read(port, 0x7FE0, true, data, bench_crc_bitwise(data, sizeof(data)));
+        }
+        if (pass == 0) {
+            sim_poll_until_saved();
+        }
+    }
+}
+
+static void sim_test_errors(void) {
+    sim_test = "errors";
+    uint8_t data[CONTROLLER_PAK_PAGE_SIZE];
+    uint8_t stored[CONTROLLER_PAK_PAGE_SIZE];
+    uint8_t frame[N64_CMD_WRITE_LENGTH + 1];
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        n64_protocol_stats_t before = sim_stats(port);
+    
+        // Bad address checksum: zeros and an inverted CRC, flagged in the status
+        sim_expect_read(port, 0x0120, false, sim_zeros, 0xFF);
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED | N64_STATUS_CRC_ERROR);
+    
+        // A write with a bad address checksum is answered but not stored
+        sim_pattern(data, 0x77);
+        sim_pattern(stored, port);
+        sim_expect_write(port, 0x0120, false, data, bench_crc_bitwise(data, sizeof(data)));
+        sim_expect_read(port, 0x0120, true, stored, bench_crc_bitwise(stored, sizeof(stored)));
+    
+        // RESET clears the error flag
+        sim_expect_info(port, N64_CMD_RESET, N64_STATUS_PAK_INSERTED);
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+    
+        // Frames of the wrong length for their command are dropped, and the
+        // port answers the next good one
+        memset(frame, 0, sizeof(frame));
+        frame[0] = N64_CMD_POLL;
+        sim_expect(port, frame, 2, NULL, 0);
+        frame[0] = N64_CMD_READ;
+        sim_expect(port, frame, N64_CMD_READ_LENGTH - 1, NULL, 0);
+        frame[0] = N64_CMD_WRITE;
+        sim_expect(port, frame, N64_CMD_WRITE_LENGTH - 1, NULL, 0);
+        sim_expect(port, frame, N64_CMD_WRITE_LENGTH + 1, NULL, 0);     // Overruns the buffer
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+    
+        n64_protocol_stats_t after = sim_stats(port);
+        SIM_CHECK(after.crc_errors - before.crc_errors == 2, "port %u counted %lu CRC errors, expected 2",
+                  port, (unsigned long)(after.crc_errors - before.crc_errors));
+        SIM_CHECK(after.frames_dropped - before.frames_dropped == 4, "port %u dropped %lu frames, expected 4",
+                  port, (unsigned long)(after.frames_dropped - before.frames_dropped));
+        SIM_CHECK(after.frames_received - before.frames_received == 11, "port %u received %lu frames, expected 11",
+                  port, (unsigned long)(after.frames_received - before.frames_received));
+    }
+}
+
+// A noise burst longer than any frame wedges the receiver; the watchdog on
+// core 0 has core 1 restart it before the next frame
+static void sim_test_resync(void) {
+    sim_test = "resync";
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        uint32_t resyncs = sim_stats(port).resyncs;
+    
+        // Nothing stalled: the watchdog leaves the port alone
+        n64_protocol_watchdog();
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+        SIM_CHECK(sim_stats(port).resyncs == resyncs, "port %u restarted without a stall", port);
+    
+        for (int i = 0; i < N64_MAX_FRAME_LENGTH + 8; i++) {
+            mock_pio_push(N64_PIO, port, 0x00);
+        }
+        SIM_CHECK(N64_PIO->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + port)), "port %u did not stall", port);
+    
+        n64_protocol_watchdog();
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+        SIM_CHECK(sim_stats(port).resyncs == resyncs + 1, "port %u restarted %lu times, expected once",
+                  port, (unsigned long)(sim_stats(port).resyncs - resyncs));
+        SIM_CHECK(!(N64_PIO->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + port))), "port %u still stalled", port);
+    }
+}
+
+// A frame that arrives while a flash write has core 1 parked is past the reply
+// deadline by the time core 1 sees it: it is dropped, not answered late
+static void sim_test_parked(void) {
+    sim_test = "parked";
+    uint8_t command = N64_CMD_INFO;
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        uint32_t dropped = sim_stats(port).frames_dropped;
+    
+        sim_park_us = PAK_FLASH_PROGRAM_US;
+        sim_expect(port, &command, 1, NULL, 0);
+        sim_park_us = 0;
+        sim_expect_info(port, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+        SIM_CHECK(sim_stats(port).frames_dropped == dropped + 1, "port %u dropped %lu frames, expected 1",
+                  port, (unsigned long)(sim_stats(port).frames_dropped - dropped));
+    }
+}
+
+// Reply latency per command, as the firmware's histograms have it
+static void sim_report_latency(void) {
+    sim_test = "latency";
+    printf("command,count,min_ns,max_ns,min_cycles,max_cycles\n");
+    
+    for (int command_class = 0; command_class < N64_COMMAND_CLASS_COUNT; command_class++) {
+        n64_latency_stats_t latency;
+        n64_protocol_get_latency((n64_command_class_t)command_class, &latency);
+    
+        SIM_CHECK(latency.count == sim_answered[command_class], "%lu %s replies timed, %lu sent",
+                  (unsigned long)latency.count, sim_class_names[command_class],
+                  (unsigned long)sim_answered[command_class]);
+        if (latency.count == 0) {
+            continue;
+        }
+        SIM_CHECK(latency.min_ns >= n64_port_IDLE_US * 1000 && latency.max_ns >= latency.min_ns,
+                  "%s latency %lu..%lu ns", sim_class_names[command_class],
+                  (unsigned long)latency.min_ns, (unsigned long)latency.max_ns);
+    
+        printf("%s,%lu,%lu,%lu,%lu,%lu\n", sim_class_names[command_class], (unsigned long)latency.count,
+               (unsigned long)latency.min_ns, (unsigned long)latency.max_ns,
+               (unsigned long)((uint64_t)latency.min_ns * (SYS_CLOCK_KHZ / 1000) / 1000),
+               (unsigned long)((uint64_t)latency.max_ns * (SYS_CLOCK_KHZ / 1000) / 1000));
+    }
+}
+
+static void sim_test_stats_reset(void) {
+    sim_test = "stats reset";
+    n64_protocol_reset_stats();
+    sim_expect_info(0, N64_CMD_INFO, N64_STATUS_PAK_INSERTED);
+    
+    n64_protocol_stats_t stats = sim_stats(0);
+    n64_latency_stats_t latency;
+    n64_protocol_get_latency(N64_COMMAND_CLASS_INFO, &latency);
+    SIM_CHECK(stats.frames_received == 1 && stats.frames_dropped == 0 && stats.crc_errors == 0 &&
+              stats.resyncs == 0 && latency.count == 1, "counters not cleared");
+}
+
+int main(void) {
+    mock_hal_init();
+    mock_wfe_set_hook(sim_console_wfe);
+    
+    // Core 1 is up before anything else, as in the firmware
+    n64_protocol_core_init();
+    SIM_CHECK(n64_protocol_init(), "n64_protocol_init failed");
+    event_log_init();
+    
+    sim_test_boot();
+    sim_test_info_reset();
+    sim_test_poll();
+    sim_test_pak();
+    sim_test_errors();
+    sim_test_resync();
+    sim_test_parked();
+    sim_report_latency();
+    sim_test_stats_reset();
+    
+    if (sim_failures) {
+        printf("%d checks failed\n", sim_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
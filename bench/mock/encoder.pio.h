@@ -0,0 +1,12 @@
+#ifndef MOCK_ENCODER_PIO_H
+#define MOCK_ENCODER_PIO_H
+
+#include "hardware/pio.h"
+
+// The decoder program itself doesn't run on the host; its counts are
+// injected with mock_pio_push
+static const pio_program_t quadrature_encoder_program = { 0 };
+
+static inline void quadrature_encoder_program_init(PIO pio, uint sm, uint pin) {}
+
+#endif // MOCK_ENCODER_PIO_H
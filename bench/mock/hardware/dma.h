@@ -0,0 +1,85 @@
+#ifndef MOCK_HARDWARE_DMA_H
+#define MOCK_HARDWARE_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+
+// DMA channels that remember their configuration, so mock_pio_push can carry
+// a value through a channel and its chain the way the hardware would. Only
+// what the firmware uses: transfer counts, write rings, chaining, and PIO TX
+// FIFOs that always have room (the mock state machines take every word).
+// Unpaced and TX-paced channels finish as soon as they are triggered.
+#define NUM_DMA_CHANNELS 12
+#define DREQ_FORCE 0x3F
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    bool ring_write;
+    uint ring_bits;             // 0: no ring
+    uint dreq;
+    uint chain_to;              // Itself: no chaining
+} dma_channel_config;
+
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;   // Left in the current run
+} dma_channel_hw_t;
+
+extern dma_channel_hw_t mock_dma_hw[NUM_DMA_CHANNELS];
+extern dma_channel_config mock_dma_config[NUM_DMA_CHANNELS];
+
+static inline dma_channel_hw_t* dma_channel_hw_addr(uint channel) {
+    return &mock_dma_hw[channel];
+}
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c = { .size = DMA_SIZE_32, .read_increment = false, .write_increment = true,
+                             .ring_write = false, .ring_bits = 0, .dreq = DREQ_FORCE, .chain_to = channel };
+    return c;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool increment) {
+    c->read_increment = increment;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool increment) {
+    c->write_increment = increment;
+}
+
+static inline void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config* c, uint chain_to) {
+    c->chain_to = chain_to;
+}
+
+// Function prototypes (mock_hal.c)
+int dma_claim_unused_channel(bool required);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void* write_addr, uint32_t transfer_count);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void* read_addr, uint32_t transfer_count);
+
+#endif // MOCK_HARDWARE_DMA_H
@@ -0,0 +1,24 @@
+#ifndef MOCK_HARDWARE_GPIO_H
+#define MOCK_HARDWARE_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+
+#define GPIO_IN false
+#define GPIO_OUT true
+#define GPIO_FUNC_UART 2
+
+// Pin levels returned by gpio_get_all (mock_gpio_set_all)
+extern uint32_t mock_gpio_levels;
+
+static inline void gpio_init(uint gpio) {}
+static inline void gpio_set_dir(uint gpio, bool out) {}
+static inline void gpio_pull_up(uint gpio) {}
+static inline void gpio_set_function(uint gpio, uint fn) {}
+
+static inline uint32_t gpio_get_all(void) {
+    return mock_gpio_levels;
+}
+
+#endif // MOCK_HARDWARE_GPIO_H
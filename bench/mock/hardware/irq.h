@@ -0,0 +1,16 @@
+#ifndef MOCK_HARDWARE_IRQ_H
+#define MOCK_HARDWARE_IRQ_H
+
+#include <stdbool.h>
+#include "pico/platform.h"
+
+// Nothing is ever routed to an interrupt on the host
+
+#define TIMER_IRQ_0 0
+#define PIO0_IRQ_0 7
+#define PIO1_IRQ_0 9
+
+static inline void irq_clear(uint num) {}
+static inline void irq_set_enabled(uint num, bool enabled) {}
+
+#endif // MOCK_HARDWARE_IRQ_H
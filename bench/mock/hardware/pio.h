@@ -0,0 +1,83 @@
+#ifndef MOCK_HARDWARE_PIO_H
+#define MOCK_HARDWARE_PIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+#include "hardware/sync.h"
+
+// Just enough of a PIO block for the firmware's registers and helpers. The
+// state machines don't run: a word "pushed" by one goes through
+// mock_pio_push, and the words it pulls are collected for mock_pio_pull
+// (mock_hal.h). FDEBUG is write-1-to-clear on the hardware; here it is
+// rebuilt from the FIFO state whenever the firmware clears or restarts one.
+typedef struct {
+    volatile uint32_t fdebug;
+    volatile uint32_t txf[4];
+    volatile uint32_t rxf[4];
+    volatile uint32_t irq;
+} pio_hw_t;
+
+typedef pio_hw_t* PIO;
+
+extern pio_hw_t mock_pio[2];
+#define pio0 (&mock_pio[0])
+#define pio1 (&mock_pio[1])
+
+#define PIO_FDEBUG_RXSTALL_LSB 0
+
+typedef struct {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+enum pio_src_dest {
+    pio_pins = 0,
+    pio_x = 1,
+    pio_y = 2,
+    pio_pindirs = 4
+};
+
+enum pio_interrupt_source {
+    pis_interrupt0 = 8
+};
+
+static inline uint pio_get_index(PIO pio) {
+    return pio == pio1 ? 1 : 0;
+}
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return pio_get_index(pio) * 8 + (is_tx ? 0 : 4) + sm;
+}
+
+static inline void pio_add_program_at_offset(PIO pio, const pio_program_t* program, uint offset) {}
+
+static inline uint pio_add_program(PIO pio, const pio_program_t* program) {
+    return 0;
+}
+
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value) {
+    return 0xE000u | ((uint)dest << 5) | value;
+}
+
+static inline uint pio_encode_jmp(uint addr) {
+    return addr;
+}
+
+static inline void pio_sm_exec(PIO pio, uint sm, uint instr) {}
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {}
+static inline void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled) {}
+static inline void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled) {}
+
+static inline void pio_interrupt_clear(PIO pio, uint irq_num) {
+    pio->irq &= ~(1u << irq_num);
+}
+
+// Function prototypes (mock_hal.c)
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_restart(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+
+#endif // MOCK_HARDWARE_PIO_H
@@ -0,0 +1,16 @@
+#ifndef MOCK_HARDWARE_STRUCTS_SCB_H
+#define MOCK_HARDWARE_STRUCTS_SCB_H
+
+#include <stdint.h>
+
+#define M0PLUS_SCR_SLEEPDEEP_BITS 0x00000004u
+#define M0PLUS_SCR_SEVONPEND_BITS 0x00000010u
+
+typedef struct {
+    volatile uint32_t scr;
+} armv6m_scb_hw_t;
+
+extern armv6m_scb_hw_t mock_scb;
+#define scb_hw (&mock_scb)
+
+#endif // MOCK_HARDWARE_STRUCTS_SCB_H
@@ -0,0 +1,21 @@
+#ifndef MOCK_HARDWARE_STRUCTS_SYSTICK_H
+#define MOCK_HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001u
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+// Counts down clk_sys cycles (SYS_CLOCK_KHZ) of host time, refreshed on
+// every access (mock_hal.c)
+systick_hw_t* mock_systick_hw(void);
+#define systick_hw (mock_systick_hw())
+
+#endif // MOCK_HARDWARE_STRUCTS_SYSTICK_H
@@ -0,0 +1,17 @@
+#ifndef MOCK_HARDWARE_SYNC_H
+#define MOCK_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {}
+
+// Function prototypes (mock_hal.c). __wfe runs the hook set with
+// mock_wfe_set_hook, standing in for whatever would wake the core.
+void __sev(void);
+void __wfe(void);
+
+#endif // MOCK_HARDWARE_SYNC_H
@@ -0,0 +1,18 @@
+#ifndef MOCK_HARDWARE_TIMER_H
+#define MOCK_HARDWARE_TIMER_H
+
+#include <stdint.h>
+
+// The timer only moves when the benchmark sets it (mock_time_set_us)
+typedef struct {
+    volatile uint32_t timerawl;
+} timer_hw_t;
+
+extern timer_hw_t mock_timer;
+#define timer_hw (&mock_timer)
+
+static inline uint32_t time_us_32(void) {
+    return timer_hw->timerawl;
+}
+
+#endif // MOCK_HARDWARE_TIMER_H
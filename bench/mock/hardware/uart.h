@@ -0,0 +1,31 @@
+#ifndef MOCK_HARDWARE_UART_H
+#define MOCK_HARDWARE_UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+
+// A UART that is never ready: the event log keeps its records in the rings
+typedef struct {
+    uint32_t baudrate;
+} uart_hw_t;
+
+typedef uart_hw_t uart_inst_t;
+
+extern uart_hw_t mock_uart[2];
+#define uart0 (&mock_uart[0])
+#define uart1 (&mock_uart[1])
+
+static inline uint uart_init(uart_inst_t* uart, uint baudrate) {
+    uart->baudrate = baudrate;
+    return baudrate;
+}
+
+static inline bool uart_is_writable(uart_inst_t* uart) {
+    return false;
+}
+
+static inline void uart_putc_raw(uart_inst_t* uart, char c) {}
+static inline void uart_tx_wait_blocking(uart_inst_t* uart) {}
+
+#endif // MOCK_HARDWARE_UART_H
@@ -0,0 +1,355 @@
+#include "mock_hal.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/timer.h"
+#include "hardware/uart.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/systick.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+uint8_t mock_flash[PICO_FLASH_SIZE_BYTES];
+uint32_t mock_gpio_levels;
+timer_hw_t mock_timer;
+pio_hw_t mock_pio[2];
+uart_hw_t mock_uart[2];
+dma_channel_hw_t mock_dma_hw[NUM_DMA_CHANNELS];
+dma_channel_config mock_dma_config[NUM_DMA_CHANNELS];
+armv6m_scb_hw_t mock_scb;
+
+static uint dma_claimed = 0;
+static bool dma_busy[NUM_DMA_CHANNELS];
+static uint32_t dma_reload[NUM_DMA_CHANNELS];
+
+// State machine FIFOs: the RX fill level, and the words pulled from TX
+#define MOCK_PIO_FIFO_DEPTH 4
+#define MOCK_PIO_TX_WORDS 32
+static uint pio_rx_level[2][4];
+static bool pio_rx_stalled[2][4];
+static uint32_t pio_tx_words[2][4][MOCK_PIO_TX_WORDS];
+static size_t pio_tx_count[2][4];
+
+static systick_hw_t mock_systick;
+static void (*wfe_hook)(void) = NULL;
+
+// Flash operations so far, and the one a simulated power cut interrupts
+static uint32_t flash_erases = 0;
+static uint32_t flash_programs = 0;
+static uint32_t flash_cut_at = 0;
+static void (*flash_cut_hook)(void) = NULL;
+
+void mock_hal_init(void) {
+    // Blank flash, buttons released (pulled up), time zero
+    memset(mock_flash, 0xFF, sizeof(mock_flash));
+    mock_gpio_levels = 0xFFFFFFFFu;
+    mock_timer.timerawl = 0;
+    memset(mock_pio, 0, sizeof(mock_pio));
+    memset(mock_dma_hw, 0, sizeof(mock_dma_hw));
+    memset(dma_busy, 0, sizeof(dma_busy));
+    memset(pio_rx_level, 0, sizeof(pio_rx_level));
+    memset(pio_rx_stalled, 0, sizeof(pio_rx_stalled));
+    memset(pio_tx_count, 0, sizeof(pio_tx_count));
+    dma_claimed = 0;
+    wfe_hook = NULL;
+    flash_erases = 0;
+    flash_programs = 0;
+    flash_cut_hook = NULL;
+}
+
+void mock_gpio_set_all(uint32_t levels) {
+    mock_gpio_levels = levels;
+}
+
+void mock_time_set_us(uint32_t time_us) {
+    mock_timer.timerawl = time_us;
+}
+
+// Flash
+
+static void mock_flash_check(uint32_t flash_offs, size_t count, uint32_t alignment) {
+    if (flash_offs % alignment != 0 || count % alignment != 0 || flash_offs + count > sizeof(mock_flash)) {
+        fprintf(stderr, "mock flash: bad range 0x%08x+0x%zx\n", flash_offs, count);
+        abort();
+    }
+}
+
+// The power goes at this operation: it gets halfway and the hook never returns
+static void mock_flash_cut(size_t* count) {
+    if (flash_cut_hook && flash_erases + flash_programs == flash_cut_at) {
+        *count /= 2;
+    }
+}
+
+static void mock_flash_done(void) {
+    if (flash_cut_hook && flash_erases + flash_programs == flash_cut_at + 1) {
+        void (*hook)(void) = flash_cut_hook;
+        flash_cut_hook = NULL;
+        hook();
+    }
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    mock_flash_check(flash_offs, count, FLASH_SECTOR_SIZE);
+    mock_flash_cut(&count);
+    
+    memset(&mock_flash[flash_offs], 0xFF, count);
+    flash_erases++;
+    mock_flash_done();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count) {
+    mock_flash_check(flash_offs, count, FLASH_PAGE_SIZE);
+    mock_flash_cut(&count);
+    
+    // Programming only clears bits
+    for (size_t i = 0; i < count; i++) {
+        mock_flash[flash_offs + i] &= data[i];
+    }
+    flash_programs++;
+    mock_flash_done();
+}
+
+uint32_t mock_flash_erases(void) {
+    return flash_erases;
+}
+
+uint32_t mock_flash_programs(void) {
+    return flash_programs;
+}
+
+void mock_flash_set_cut(uint32_t operation, void (*hook)(void)) {
+    flash_cut_at = operation;
+    flash_cut_hook = hook;
+}
+
+// DMA
+
+int dma_claim_unused_channel(bool required) {
+    if (dma_claimed == NUM_DMA_CHANNELS) {
+        if (required) {
+            fprintf(stderr, "mock dma: no free channel\n");
+            abort();
+        }
+        return -1;
+    }
+    return dma_claimed++;
+}
+
+// The PIO state machine whose TX FIFO a DMA write lands in, if any
+static bool mock_pio_tx_target(uintptr_t addr, PIO* pio, uint* sm) {
+    for (uint i = 0; i < 2; i++) {
+        uintptr_t base = (uintptr_t)&mock_pio[i].txf[0];
+        if (addr >= base && addr < base + sizeof(mock_pio[i].txf)) {
+            *pio = &mock_pio[i];
+            *sm = (uint)((addr - base) / sizeof(uint32_t));
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool mock_dreq_is_pio_tx(uint dreq) {
+    return dreq < 16 && (dreq & 4) == 0;
+}
+
+static void mock_dma_trigger(uint channel);
+
+// One transfer, wrapping the write address inside its ring. The last one
+// ends the run and triggers the channel it chains to.
+static void mock_dma_transfer(uint channel) {
+    dma_channel_config* config = &mock_dma_config[channel];
+    dma_channel_hw_t* hw = &mock_dma_hw[channel];
+    uint32_t step = 1u << config->size;
+    
+    // Each word moves in one bus access, so it reads like an atomic load next
+    // to a core writing the buffer
+    uint32_t value;
+    switch (config->size) {
+        case DMA_SIZE_8:  value = *(const volatile uint8_t*)hw->read_addr; break;
+        case DMA_SIZE_16: value = *(const volatile uint16_t*)hw->read_addr; break;
+        default:          value = __atomic_load_n((const volatile uint32_t*)hw->read_addr, __ATOMIC_RELAXED); break;
+    }
+    
+    PIO pio;
+    uint sm;
+    if (mock_pio_tx_target(hw->write_addr, &pio, &sm)) {
+        pio_sm_put(pio, sm, value);
+    } else if (config->size == DMA_SIZE_8) {
+        *(volatile uint8_t*)hw->write_addr = (uint8_t)value;
+    } else if (config->size == DMA_SIZE_16) {
+        *(volatile uint16_t*)hw->write_addr = (uint16_t)value;
+    } else {
+        *(volatile uint32_t*)hw->write_addr = value;
+    }
+    
+    if (config->read_increment) {
+        hw->read_addr += step;
+    }
+    if (config->write_increment) {
+        uintptr_t next = hw->write_addr + step;
+        if (config->ring_write && config->ring_bits) {
+            uintptr_t mask = ((uintptr_t)1 << config->ring_bits) - 1;
+            next = (hw->write_addr & ~mask) | (next & mask);
+        }
+        hw->write_addr = next;
+    }
+    
+    if (--hw->transfer_count == 0) {
+        dma_busy[channel] = false;
+        if (config->chain_to != channel) {
+            mock_dma_trigger(config->chain_to);
+        }
+    }
+}
+
+// Start a run of the programmed length. Channels that aren't paced by a PIO
+// RX FIFO have their data at hand and finish at once.
+static void mock_dma_trigger(uint channel) {
+    mock_dma_hw[channel].transfer_count = dma_reload[channel];
+    dma_busy[channel] = dma_reload[channel] != 0;
+    
+    uint dreq = mock_dma_config[channel].dreq;
+    if (dreq == DREQ_FORCE || mock_dreq_is_pio_tx(dreq)) {
+        while (dma_busy[channel]) {
+            mock_dma_transfer(channel);
+        }
+    }
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger) {
+    mock_dma_config[channel] = *config;
+    mock_dma_hw[channel].write_addr = (uintptr_t)write_addr;
+    mock_dma_hw[channel].read_addr = (uintptr_t)read_addr;
+    mock_dma_hw[channel].transfer_count = transfer_count;
+    dma_reload[channel] = transfer_count;
+    if (trigger) {
+        mock_dma_trigger(channel);
+    }
+}
+
+void dma_channel_start(uint channel) {
+    mock_dma_trigger(channel);
+}
+
+void dma_channel_abort(uint channel) {
+    dma_busy[channel] = false;
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void* write_addr, uint32_t transfer_count) {
+    mock_dma_hw[channel].write_addr = (uintptr_t)write_addr;
+    dma_reload[channel] = transfer_count;
+    mock_dma_trigger(channel);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void* read_addr, uint32_t transfer_count) {
+    mock_dma_hw[channel].read_addr = (uintptr_t)read_addr;
+    dma_reload[channel] = transfer_count;
+    mock_dma_trigger(channel);
+}
+
+// PIO
+
+static void mock_pio_update_fdebug(PIO pio) {
+    uint index = pio_get_index(pio);
+    uint32_t stalled = 0;
+    for (uint sm = 0; sm < 4; sm++) {
+        if (pio_rx_stalled[index][sm]) {
+            stalled |= 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+        }
+    }
+    pio->fdebug = stalled;
+}
+
+// A state machine pushes a word: a running channel paced by its RX DREQ
+// takes it, otherwise it waits in the FIFO. With the FIFO full the state
+// machine stalls (FDEBUG RXSTALL) and the word is lost.
+void mock_pio_push(PIO pio, uint sm, uint32_t value) {
+    uint index = pio_get_index(pio);
+    uint dreq = pio_get_dreq(pio, sm, false);
+    
+    pio->rxf[sm] = value;
+    for (uint channel = 0; channel < dma_claimed; channel++) {
+        if (dma_busy[channel] && mock_dma_config[channel].dreq == dreq) {
+            mock_dma_transfer(channel);
+            return;
+        }
+    }
+    
+    if (pio_rx_level[index][sm] < MOCK_PIO_FIFO_DEPTH) {
+        pio_rx_level[index][sm]++;
+    } else {
+        pio_rx_stalled[index][sm] = true;
+        mock_pio_update_fdebug(pio);
+    }
+}
+
+// A word for the state machine (from the CPU or a DMA), kept for mock_pio_pull
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    uint index = pio_get_index(pio);
+    
+    pio->txf[sm] = data;
+    if (pio_tx_count[index][sm] < MOCK_PIO_TX_WORDS) {
+        pio_tx_words[index][sm][pio_tx_count[index][sm]] = data;
+    }
+    pio_tx_count[index][sm]++;
+}
+
+size_t mock_pio_pull(PIO pio, uint sm, uint32_t* words, size_t max_words) {
+    uint index = pio_get_index(pio);
+    size_t count = pio_tx_count[index][sm];
+    
+    for (size_t i = 0; i < count && i < max_words && i < MOCK_PIO_TX_WORDS; i++) {
+        words[i] = pio_tx_words[index][sm][i];
+    }
+    pio_tx_count[index][sm] = 0;
+    return count;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    pio_rx_level[pio_get_index(pio)][sm] = 0;
+    pio_rx_stalled[pio_get_index(pio)][sm] = false;
+    mock_pio_update_fdebug(pio);
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+    pio_sm_clear_fifos(pio, sm);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return pio_rx_level[pio_get_index(pio)][sm] == 0;
+}
+
+// Cores
+
+void mock_wfe_set_hook(void (*hook)(void)) {
+    wfe_hook = hook;
+}
+
+void __wfe(void) {
+    // Nothing else can wake a single-threaded host
+    if (!wfe_hook) {
+        fprintf(stderr, "mock: __wfe with nothing to wake the core\n");
+        abort();
+    }
+    wfe_hook();
+}
+
+void __sev(void) {
+}
+
+// Cycles of host time at the configured clk_sys, counting down like SysTick
+systick_hw_t* mock_systick_hw(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    uint64_t cycles = ns * (SYS_CLOCK_KHZ / 1000) / 1000;
+    
+    mock_systick.cvr = (uint32_t)(0x00FFFFFFu - (cycles & 0x00FFFFFFu));
+    return &mock_systick;
+}
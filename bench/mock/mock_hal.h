@@ -0,0 +1,27 @@
+#ifndef MOCK_HAL_H
+#define MOCK_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pico/platform.h"
+#include "hardware/pio.h"
+
+// Host-side controls for the mock HAL: the benchmark and the simulators set
+// inputs and time directly instead of waiting for hardware
+
+// Function prototypes
+void mock_hal_init(void);
+void mock_gpio_set_all(uint32_t levels);
+void mock_time_set_us(uint32_t time_us);
+void mock_pio_push(PIO pio, uint sm, uint32_t value);
+size_t mock_pio_pull(PIO pio, uint sm, uint32_t* words, size_t max_words);
+void mock_wfe_set_hook(void (*hook)(void));
+
+// Flash erases and programs since mock_hal_init(). A power cut stops flash
+// operation number `operation` (counting both) halfway through and calls the
+// hook, which must not return (longjmp out).
+uint32_t mock_flash_erases(void);
+uint32_t mock_flash_programs(void);
+void mock_flash_set_cut(uint32_t operation, void (*hook)(void));
+
+#endif // MOCK_HAL_H
@@ -0,0 +1,25 @@
+#ifndef MOCK_N64_PROTOCOL_PIO_H
+#define MOCK_N64_PROTOCOL_PIO_H
+
+#include "hardware/pio.h"
+
+// The port program doesn't run on the host: the console simulator pushes the
+// received bytes and collects the reply words itself. The public defines are
+// those of n64_protocol.pio; n64_protocol.c checks them against config.h.
+#define n64_port_CYCLES_PER_US 8
+#define n64_port_SAMPLE_US 2
+#define n64_port_IDLE_US 4
+#define n64_port_LOW_US 1
+#define n64_port_DATA_US 2
+#define n64_port_HIGH_US 1
+#define n64_port_STOP_LOW_US 2
+#define n64_port_STOP_HIGH_US 1
+#define n64_port_FRAME_IRQ 0
+
+#define n64_port_offset_rx_entry 0u
+
+static const pio_program_t n64_port_program = { 0 };
+
+static inline void n64_port_program_init(PIO pio, uint sm, uint offset, uint pin) {}
+
+#endif // MOCK_N64_PROTOCOL_PIO_H
@@ -0,0 +1,16 @@
+#ifndef MOCK_PICO_MULTICORE_H
+#define MOCK_PICO_MULTICORE_H
+
+#include <stdbool.h>
+#include "pico/platform.h"
+
+// Single core on the host: there is never a victim to park
+
+static inline bool multicore_lockout_victim_is_initialized(uint core) {
+    return false;
+}
+
+static inline void multicore_lockout_start_blocking(void) {}
+static inline void multicore_lockout_end_blocking(void) {}
+
+#endif // MOCK_PICO_MULTICORE_H
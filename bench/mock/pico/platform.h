@@ -0,0 +1,24 @@
+#ifndef MOCK_PICO_PLATFORM_H
+#define MOCK_PICO_PLATFORM_H
+
+#include <stdint.h>
+
+// Host stand-in for the SDK platform header: no sections, flash is an array
+
+#define PICO_ON_DEVICE 0
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(name) name
+
+typedef unsigned int uint;
+
+// XIP window onto the mock flash (see mock_hal.c)
+extern uint8_t mock_flash[];
+#define XIP_BASE ((uintptr_t)mock_flash)
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+static inline uint get_core_num(void) {
+    return 0;
+}
+
+#endif // MOCK_PICO_PLATFORM_H
@@ -0,0 +1,23 @@
+#ifndef MOCK_PICO_STDLIB_H
+#define MOCK_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+typedef struct {
+    uint64_t us;
+} absolute_time_t;
+
+static inline absolute_time_t get_absolute_time(void) {
+    absolute_time_t time = { time_us_32() };
+    return time;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t time) {
+    return (uint32_t)(time.us / 1000);
+}
+
+#endif // MOCK_PICO_STDLIB_H
@@ -0,0 +1,394 @@
+#include "config.h"
+#include "controller_pak.h"
+#include "mock_hal.h"
+#include "hardware/flash.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Persistence checks for the controller pak flash log
+//
+// controller_pak.c runs against the mock flash. Every "boot" is a fresh
+// controller_pak_init() that rebuilds the pak from whatever the flash holds,
+// and the image it reads back is compared with a model of what was written.
+// Power cuts stop a flash operation halfway (half a page programmed, half a
+// sector erased) and jump straight to the next boot, once for every operation
+// of a sequence. After a cut every page must read back as either what was last
+// saved or what was being saved.
+
+#define PAK_TEST_LOG_BLOCKS (FLASH_STORAGE_SECTORS * (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE))
+#define PAK_TEST_COLD_PAGES 300     // Written once, so compaction has to move them
+#define PAK_TEST_HOT_PAGES 16       // Rewritten over and over
+#define PAK_TEST_CUT_SAVES 80       // Saves in the sequence cut at every flash operation
+#define PAK_TEST_POLL_US 16667      // Console poll period while saves run between polls
+
+typedef uint8_t pak_image_t[N64_PORT_COUNT][CONTROLLER_PAK_SIZE];
+
+static int test_failures = 0;
+static const char* test_name = "";
+
+// Saved contents, and what the save in progress (if any) is writing
+static pak_image_t saved;
+static pak_image_t pending;
+
+// Flash region the cut runs start from
+static uint8_t start_flash[FLASH_STORAGE_SECTORS * FLASH_SECTOR_SIZE];
+static pak_image_t start_image;
+
+static jmp_buf power_cut;
+
+static void test_fail(const char* format, ...) {
+    va_list args;
+    
+    printf("FAIL %s: ", test_name);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    test_failures++;
+}
+
+#define TEST_CHECK(condition, ...) do { if (!(condition)) test_fail(__VA_ARGS__); } while (0)
+
+// The pak only touches flash between polls; the tests say when that is
+static uint32_t idle_window_us = UINT32_MAX;
+
+bool n64_protocol_idle_window(uint32_t duration_us) {
+    return duration_us <= idle_window_us;
+}
+
+// Core 1 isn't running here, so it is never parked
+void n64_protocol_park_begin(void) {
+}
+
+void n64_protocol_park_end(void) {
+}
+
+static void test_power_cut(void) {
+    longjmp(power_cut, 1);
+}
+
+static uint32_t test_flash_operations(void) {
+    return mock_flash_erases() + mock_flash_programs();
+}
+
+// Contents of a page for the nth save that writes it
+static void test_page_data(uint8_t* data, uint32_t page, uint32_t save) {
+    for (size_t i = 0; i < CONTROLLER_PAK_PAGE_SIZE; i++) {
+        data[i] = (uint8_t)(page * 13 + save * 7 + i * 3 + 1);
+    }
+}
+
+// A freshly formatted pak: zeros and the ID pattern at the start
+static void test_formatted(pak_image_t image) {
+    static const uint8_t pak_id[] = { 0x81, 0x80, 0x80, 0x80 };
+    
+    memset(image, 0, sizeof(pak_image_t));
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        memcpy(image[port], pak_id, sizeof(pak_id));
+    }
+}
+
+static void test_boot(void) {
+    TEST_CHECK(controller_pak_init(), "controller_pak_init failed");
+}
+
+// Write pages through the console path and record them as pending
+static void test_write(uint32_t first, uint32_t count, uint32_t save) {
+    uint8_t data[CONTROLLER_PAK_PAGE_SIZE];
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t page = (first + i) % (N64_PORT_COUNT * CONTROLLER_PAK_PAGES);
+        uint8_t port = (uint8_t)(page / CONTROLLER_PAK_PAGES);
+        uint16_t address = (uint16_t)(page % CONTROLLER_PAK_PAGES * CONTROLLER_PAK_PAGE_SIZE);
+    
+        test_page_data(data, page, save);
+        TEST_CHECK(controller_pak_write(port, address, data, sizeof(data)), "write to page %lu refused",
+                   (unsigned long)page);
+        memcpy(&pending[port][address], data, sizeof(data));
+    }
+}
+
+// Save everything written so far; the pending contents become the saved ones
+static void test_save(void) {
+    controller_pak_save_to_flash();
+    memcpy(saved, pending, sizeof(pak_image_t));
+}
+
+// Every page reads back as one of the allowed images (both the same when no
+// save was cut short). Returns false after the first few mismatches.
+static bool test_check_image(const pak_image_t first, const pak_image_t second) {
+    uint8_t data[CONTROLLER_PAK_PAGE_SIZE];
+    int mismatches = 0;
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        for (uint32_t address = 0; address < CONTROLLER_PAK_SIZE; address += CONTROLLER_PAK_PAGE_SIZE) {
+            controller_pak_read(port, (uint16_t)address, data, sizeof(data));
+            if (memcmp(data, &first[port][address], sizeof(data)) == 0 ||
+                memcmp(data, &second[port][address], sizeof(data)) == 0) {
+                continue;
+            }
+            if (mismatches++ < 4) {
+                test_fail("port %u page 0x%04lx reads %02x %02x %02x.., expected %02x %02x %02x..",
+                          port, (unsigned long)address, data[0], data[1], data[2],
+                          first[port][address], first[port][address + 1], first[port][address + 2]);
+            }
+        }
+    }
+    return mismatches == 0;
+}
+
+// Sequences
+
+// A blank region boots as a formatted pak, and so does the next boot
+static void test_format(void) {
+    test_name = "format";
+    
+    test_boot();
+    test_formatted(saved);
+    memcpy(pending, saved, sizeof(pak_image_t));
+    test_check_image(saved, saved);
+    
+    test_boot();
+    test_check_image(saved, saved);
+}
+
+// Pages saved several times come back with their newest copy, whatever order
+// the copies were written in
+static void test_replay(void) {
+    test_name = "replay";
+    
+    for (uint32_t save = 0; save < 8; save++) {
+        test_write(save * 3, 12, save);
+        test_save();
+    }
+    test_boot();
+    test_check_image(saved, saved);
+}
+
+// A block cut off while it was being programmed fails its checksum and the
+// pages in it come back with their previous contents. The boot after that
+// goes on past the torn block.
+static void test_torn_block(void) {
+    test_name = "torn block";
+    
+    test_write(40, 7, 100);
+    if (setjmp(power_cut) == 0) {
+        mock_flash_set_cut(test_flash_operations(), test_power_cut);
+        test_save();
+        test_fail("save finished without a flash operation");
+    }
+    test_boot();
+    test_check_image(saved, saved);
+    memcpy(pending, saved, sizeof(pak_image_t));
+    
+    test_write(40, 7, 101);
+    test_save();
+    test_boot();
+    test_check_image(saved, saved);
+}
+
+// The nth save of the wear sequence: a few hot pages, and at the start the
+// cold ones that compaction has to carry along
+static void test_wear_save(uint32_t save) {
+    if (save * 7 < PAK_TEST_COLD_PAGES) {
+        test_write(100 + save * 7, 7, save);
+    } else {
+        test_write(save % PAK_TEST_HOT_PAGES, 1 + save % 3, save);
+    }
+    test_save();
+}
+
+// Keep saving until the log has wrapped around the region more than once,
+// booting again now and then. Sectors keep getting compacted and erased, and
+// the cold pages written first have to survive all of it.
+static uint32_t test_wear(void) {
+    test_name = "compaction";
+    uint32_t erases = mock_flash_erases();
+    uint32_t programs = mock_flash_programs();
+    uint32_t save = 0;
+    
+    for (; mock_flash_programs() - programs < 2 * PAK_TEST_LOG_BLOCKS; save++) {
+        test_wear_save(save);
+        if (save % 97 == 0) {
+            test_boot();
+            test_check_image(saved, saved);
+        }
+    }
+    TEST_CHECK(mock_flash_erases() - erases >= FLASH_STORAGE_SECTORS, "only %lu sectors erased while the log wrapped",
+               (unsigned long)(mock_flash_erases() - erases));
+    
+    test_boot();
+    test_check_image(saved, saved);
+    return save;
+}
+
+// Continue the wear sequence from where test_wear() left it, cutting the power
+// at each of its flash operations in turn. The sequence is long enough to
+// compact and erase sectors, and starts close to the end of the region so the
+// head wraps around.
+static void test_power_cuts(uint32_t first_save) {
+    test_name = "power cuts";
+    
+    // Run up to near the end of the region first
+    uint32_t save = first_save;
+    while ((mock_flash_programs() + PAK_TEST_CUT_SAVES / 2) % PAK_TEST_LOG_BLOCKS != 0) {
+        test_wear_save(save++);
+    }
+    memcpy(start_flash, &mock_flash[FLASH_STORAGE_OFFSET], sizeof(start_flash));
+    memcpy(start_image, saved, sizeof(pak_image_t));
+    
+    // One clean run to count the flash operations
+    uint32_t start = test_flash_operations();
+    uint32_t erases = mock_flash_erases();
+    for (uint32_t i = 0; i < PAK_TEST_CUT_SAVES; i++) {
+        test_wear_save(save + i);
+    }
+    uint32_t operations = test_flash_operations() - start;
+    TEST_CHECK(mock_flash_erases() > erases, "no sector erased in the cut sequence");
+    
+    uint32_t failed = 0;
+    for (uint32_t cut = 0; cut < operations; cut++) {
+        memcpy(&mock_flash[FLASH_STORAGE_OFFSET], start_flash, sizeof(start_flash));
+        memcpy(saved, start_image, sizeof(pak_image_t));
+        memcpy(pending, start_image, sizeof(pak_image_t));
+        test_boot();
+    
+        if (setjmp(power_cut) == 0) {
+            mock_flash_set_cut(test_flash_operations() + cut, test_power_cut);
+            for (uint32_t i = 0; i < PAK_TEST_CUT_SAVES; i++) {
+                test_wear_save(save + i);
+            }
+            test_fail("cut %lu never came", (unsigned long)cut);
+        }
+    
+        // The boot after the cut, and one more after saving on top of it
+        test_boot();
+        if (!test_check_image(saved, pending)) {
+            printf("  after a cut at flash operation %lu of %lu\n", (unsigned long)cut, (unsigned long)operations);
+            failed++;
+            continue;
+        }
+        // Whatever the cut left is what the next save builds on
+        for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+            controller_pak_read(port, 0, saved[port], CONTROLLER_PAK_SIZE);
+        }
+        memcpy(pending, saved, sizeof(pak_image_t));
+        test_write(200, 7, save + PAK_TEST_CUT_SAVES);
+        test_save();
+        test_boot();
+        if (!test_check_image(saved, saved)) {
+            printf("  saving after a cut at flash operation %lu of %lu\n", (unsigned long)cut,
+                   (unsigned long)operations);
+            failed++;
+        }
+    }
+    printf("power cuts: %lu flash operations cut, %lu failed\n", (unsigned long)operations, (unsigned long)failed);
+}
+
+// While the console polls only programs fit between polls. A game rewriting
+// the whole pak then never waits on an erase, even with the log worn in:
+// compaction starts early enough that there is room for all of it.
+static void test_polling_rewrite(void) {
+    test_name = "polling rewrite";
+    uint32_t erases = mock_flash_erases();
+    uint32_t now_us = 0;
+    
+    idle_window_us = PAK_FLASH_PROGRAM_US;
+    for (uint32_t page = 0; page < CONTROLLER_PAK_PAGES; page++) {
+        test_write(page, 1, 500);
+        now_us += PAK_TEST_POLL_US;
+        mock_time_set_us(now_us);
+        controller_pak_task();
+    }
+    for (uint32_t frame = 0; frame < 10 * CONTROLLER_PAK_PAGES && controller_pak_save_pending(); frame++) {
+        now_us += PAK_TEST_POLL_US;
+        mock_time_set_us(now_us);
+        controller_pak_task();
+    }
+    idle_window_us = UINT32_MAX;
+    
+    TEST_CHECK(!controller_pak_save_pending(), "rewrite not saved while the console polled");
+    TEST_CHECK(mock_flash_erases() == erases, "%lu sectors erased while the console polled",
+               (unsigned long)(mock_flash_erases() - erases));
+    memcpy(saved, pending, sizeof(pak_image_t));
+    test_boot();
+    test_check_image(saved, saved);
+}
+
+// Flash as older firmware left it: the first port's raw image at the start of
+// the region, nothing else
+static void test_legacy_flash(pak_image_t image) {
+    test_formatted(image);
+    for (uint32_t page = 0; page < CONTROLLER_PAK_PAGES; page++) {
+        test_page_data(&image[0][page * CONTROLLER_PAK_PAGE_SIZE], page, 900);
+    }
+    
+    memset(&mock_flash[FLASH_STORAGE_OFFSET], 0xFF, sizeof(start_flash));
+    memcpy(&mock_flash[FLASH_STORAGE_OFFSET], image[0], CONTROLLER_PAK_SIZE);
+}
+
+// An image left by older firmware is copied into the log at boot. Power cuts
+// anywhere in the copy, and again while the next boot resumes it, still end
+// with the image in the log and the raw copy gone.
+static void test_legacy_import(void) {
+    test_name = "legacy import";
+    
+    // One clean import to count its flash operations
+    test_legacy_flash(saved);
+    uint32_t start = test_flash_operations();
+    test_boot();
+    uint32_t operations = test_flash_operations() - start;
+    test_check_image(saved, saved);
+    
+    test_boot();
+    TEST_CHECK(test_flash_operations() - start == operations, "the import ran again on the next boot");
+    test_check_image(saved, saved);
+    
+    uint32_t failed = 0;
+    for (uint32_t cut = 0; cut < operations; cut++) {
+        test_legacy_flash(saved);
+    
+        // Cut once in the import, and once more halfway into the boot that resumes it
+        for (uint32_t boot = 0; boot < 2; boot++) {
+            if (setjmp(power_cut) == 0) {
+                mock_flash_set_cut(test_flash_operations() + (boot == 0 ? cut : cut / 2), test_power_cut);
+                test_boot();
+                mock_flash_set_cut(0, NULL);
+            }
+        }
+        test_boot();
+        if (!test_check_image(saved, saved)) {
+            printf("  after a cut at flash operation %lu of %lu\n", (unsigned long)cut, (unsigned long)operations);
+            failed++;
+        }
+    }
+    printf("legacy import: %lu flash operations cut, %lu failed\n", (unsigned long)operations, (unsigned long)failed);
+    
+    // Saves go on in the log, and the image is never read again
+    memcpy(pending, saved, sizeof(pak_image_t));
+    test_write(0, 20, 901);
+    test_save();
+    test_boot();
+    test_check_image(saved, saved);
+}
+
+int main(void) {
+    mock_hal_init();
+    
+    test_format();
+    test_replay();
+    test_torn_block();
+    uint32_t save = test_wear();
+    test_polling_rewrite();
+    test_power_cuts(save);
+    test_legacy_import();
+    
+    if (test_failures) {
+        printf("%d checks failed\n", test_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
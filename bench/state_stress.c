@@ -0,0 +1,173 @@
+#include "config.h"
+#include "n64_protocol.h"
+#include "n64_protocol.pio.h"
+#include "buttons.h"
+#include "joybus.h"
+#include "mock_hal.h"
+#include "hardware/pio.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Stress test for the controller state handoff between the cores
+//
+// A writer thread plays core 0 and publishes controller states as fast as it
+// can through n64_protocol_update_state(). The main thread plays core 1: it
+// answers POLLs through n64_protocol_task() (the published reply buffer,
+// carried out by the mock DMA) and reads n64_protocol_get_state(). Each state
+// is built from a 7-bit sequence number, with every byte a different one-to-one
+// function of it. A reply or state that mixes bytes from two updates
+// therefore fails the check. Start is never pressed, so the reset bit never
+// changes a reply.
+
+#define STRESS_READS 1000000    // At least this many POLL + get_state rounds (or argv[1])
+#define STRESS_CHANGES 300      // and until the reader has seen this many new states
+#define STRESS_MAX_S 30         // On one CPU the threads only meet at preemptions
+
+// The state for a sequence number (0..127)
+static void stress_state(uint32_t sequence, n64_controller_state_t* state) {
+    uint8_t high = (uint8_t)sequence;
+    uint8_t low = (uint8_t)((sequence & 0x07) | ((sequence & 0x78) << 1));     // Skips Start (bit 3)
+    
+    state->buttons = (uint16_t)((high << 8) | low);
+    state->stick_x = (int8_t)(sequence ^ 0x55);
+    state->stick_y = (int8_t)(sequence ^ 0x2A);
+}
+
+// True if the four on-wire bytes all come from one sequence number
+static bool stress_consistent(const uint8_t* bytes) {
+    n64_controller_state_t expected;
+    if (bytes[0] & 0x80) {
+        return false;
+    }
+    stress_state(bytes[0], &expected);
+    return bytes[1] == (uint8_t)expected.buttons &&
+           bytes[2] == (uint8_t)expected.stick_x &&
+           bytes[3] == (uint8_t)expected.stick_y;
+}
+
+static bool stress_done = false;
+static uint32_t stress_updates = 0;
+
+// Core 0: publish a new state on every port, over and over
+static void* stress_writer(void* arg) {
+    uint32_t sequence = 0;
+    n64_controller_state_t state;
+    
+    while (!__atomic_load_n(&stress_done, __ATOMIC_RELAXED)) {
+        stress_state(sequence & 0x7F, &state);
+        for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+            n64_protocol_update_state(port, &state);
+        }
+        sequence++;
+    }
+    __atomic_store_n(&stress_updates, sequence, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Core 1 waits for a frame: the console sends a POLL on the current port
+static uint8_t stress_port = 0;
+
+static void stress_console_wfe(void) {
+    mock_pio_push(N64_PIO, stress_port, N64_CMD_POLL);
+    N64_PIO->irq |= 1u << (n64_port_FRAME_IRQ + stress_port);
+}
+
+// One POLL through the reply path, decoded from the words the state machine got
+static bool stress_poll(uint8_t port, uint8_t* bytes) {
+    uint32_t words[JOYBUS_TX_FRAME_WORDS(N64_MAX_RESPONSE_LENGTH)];
+    
+    stress_port = port;
+    n64_protocol_task();
+    size_t count = mock_pio_pull(N64_PIO, port, words, sizeof(words) / sizeof(words[0]));
+    if (count != JOYBUS_TX_FRAME_WORDS(N64_POLL_RESPONSE_LENGTH) || words[0] != N64_POLL_RESPONSE_LENGTH * 8 - 1) {
+        printf("FAIL: port %u POLL reply is %zu words, bit count %lu\n", port, count,
+               (unsigned long)(count ? words[0] + 1 : 0));
+        return false;
+    }
+    
+    for (int i = 0; i < N64_POLL_RESPONSE_LENGTH; i++) {
+        bytes[i] = (uint8_t)(words[1] >> (24 - 8 * i));
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t reads = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : STRESS_READS;
+    uint32_t torn_polls = 0;
+    uint32_t torn_states = 0;
+    uint32_t changes = 0;
+    uint8_t last = 0xFF;
+    bool failed = false;
+    
+    mock_hal_init();
+    mock_wfe_set_hook(stress_console_wfe);
+    n64_protocol_core_init();
+    n64_protocol_init();
+    
+    // Something consistent is published before the first POLL, as at boot
+    n64_controller_state_t state;
+    stress_state(0, &state);
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        n64_protocol_update_state(port, &state);
+    }
+    
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, stress_writer, NULL) != 0) {
+        printf("FAIL: no writer thread\n");
+        return 1;
+    }
+    
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    uint32_t i = 0;
+    for (; i < reads || changes < STRESS_CHANGES; i++) {
+        uint8_t port = (uint8_t)(i % N64_PORT_COUNT);
+        uint8_t bytes[N64_POLL_RESPONSE_LENGTH];
+    
+        if (!stress_poll(port, bytes)) {
+            failed = true;
+            break;
+        }
+        if (!stress_consistent(bytes)) {
+            if (torn_polls++ < 8) {
+                printf("FAIL: torn POLL reply on port %u: %02x %02x %02x %02x\n",
+                       port, bytes[0], bytes[1], bytes[2], bytes[3]);
+            }
+        }
+        if (bytes[0] != last) {
+            changes++;
+            last = bytes[0];
+        }
+    
+        n64_protocol_get_state(port, &state);
+        uint32_t word = n64_state_pack(&state);
+        uint8_t state_bytes[4] = { (uint8_t)(word >> 24), (uint8_t)(word >> 16), (uint8_t)(word >> 8), (uint8_t)word };
+        if (!stress_consistent(state_bytes)) {
+            if (torn_states++ < 8) {
+                printf("FAIL: torn state on port %u: %08lx\n", port, (unsigned long)word);
+            }
+        }
+    
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - start.tv_sec >= STRESS_MAX_S) {
+            break;
+        }
+    }
+    
+    __atomic_store_n(&stress_done, true, __ATOMIC_RELAXED);
+    pthread_join(writer, NULL);
+    
+    printf("reads=%lu updates=%lu reply_changes=%lu torn_polls=%lu torn_states=%lu\n",
+           (unsigned long)i, (unsigned long)stress_updates, (unsigned long)changes,
+           (unsigned long)torn_polls, (unsigned long)torn_states);
+    
+    // A run where the writer never got in between reads proves nothing
+    if (changes < STRESS_CHANGES) {
+        printf("FAIL: only %lu new states seen, the threads hardly overlapped\n", (unsigned long)changes);
+        return 1;
+    }
+    return (failed || torn_polls || torn_states) ? 1 : 0;
+}
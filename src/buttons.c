@@ -2,6 +2,7 @@
 #include "config.h"
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#include <stddef.h>
 
 // Button pin mapping
 static const uint button_pins[] = {
@@ -40,53 +41,75 @@ static const uint16_t button_masks[] = {
 
 #define NUM_BUTTONS (sizeof(button_pins) / sizeof(button_pins[0]))
 
+// Mapping from the GPIO bank to N64 button bits, one table per byte of the
+// bank: the pressed buttons are the OR of four lookups on a single read
+#define BANK_BYTES 4
+static uint16_t button_map[BANK_BYTES][256];
+
 // Debouncing state
+//
+// Presses are taken on the first sample that sees them. A release has to be
+// seen on 3 consecutive samples: each button has a 2-bit counter, kept as two
+// bit planes so all buttons count at once, that restarts whenever the button
+// reads pressed again.
 static uint16_t button_state = 0;
-static uint16_t button_state_prev = 0;
-static uint32_t debounce_timer = 0;
-
-#define DEBOUNCE_TIME_MS 5
+static uint16_t release_count0 = 0;
+static uint16_t release_count1 = 0;
 
 void buttons_init(void) {
     // Initialize all button pins
-    for (int i = 0; i < NUM_BUTTONS; i++) {
+    for (size_t i = 0; i < NUM_BUTTONS; i++) {
         gpio_init(button_pins[i]);
         gpio_set_dir(button_pins[i], GPIO_IN);
         gpio_pull_up(button_pins[i]); // Buttons pull to ground when pressed
     }
     
+    // Build the bank-to-button tables
+    for (uint byte = 0; byte < BANK_BYTES; byte++) {
+        for (uint value = 0; value < 256; value++) {
+            uint16_t buttons = 0;
+            
+            for (size_t i = 0; i < NUM_BUTTONS; i++) {
+                if (button_pins[i] / 8 == byte && (value & (1u << (button_pins[i] % 8)))) {
+                    buttons |= button_masks[i];
+                }
+            }
+            button_map[byte][value] = buttons;
+        }
+    }
+    
     button_state = 0;
-    button_state_prev = 0;
-    debounce_timer = to_ms_since_boot(get_absolute_time());
+    release_count0 = 0;
+    release_count1 = 0;
 }
 
+// Current pin levels with no debouncing
+uint16_t __not_in_flash_func(buttons_read_raw)(void) {
+    // Button is pressed when pin reads low (active low with pull-up)
+    uint32_t pressed = ~gpio_get_all();
+    
+    return button_map[0][pressed & 0xFF] |
+           button_map[1][(pressed >> 8) & 0xFF] |
+           button_map[2][(pressed >> 16) & 0xFF] |
+           button_map[3][pressed >> 24];
+}
+
+// Take one sample and update the debounced state (call at a steady rate)
 uint16_t buttons_read(void) {
-    uint32_t current_time = to_ms_since_boot(get_absolute_time());
+    uint16_t raw = buttons_read_raw();
     
-    // Only update button state if debounce period has passed
-    if (current_time - debounce_timer >= DEBOUNCE_TIME_MS) {
-        uint16_t new_state = 0;
-        
-        // Read all button pins
-        for (int i = 0; i < NUM_BUTTONS; i++) {
-            // Button is pressed when pin reads low (active low with pull-up)
-            if (!gpio_get(button_pins[i])) {
-                new_state |= button_masks[i];
-            }
-        }
-        
-        // Only update if state has changed
-        if (new_state != button_state_prev) {
-            button_state = new_state;
-            button_state_prev = new_state;
-            debounce_timer = current_time;
-        }
-    }
+    // Held buttons that read released count up, everything else restarts
+    uint16_t releasing = button_state & ~raw;
+    release_count1 = (release_count1 ^ release_count0) & releasing;
+    release_count0 = ~release_count0 & releasing;
+    
+    uint16_t released = release_count0 & release_count1;
+    button_state = (button_state | raw) & ~released;
     
     return button_state;
 }
 
 bool buttons_is_reset_pressed(void) {
-    uint16_t current_buttons = buttons_read();
-    return (current_buttons & N64_RESET_MASK) == N64_RESET_MASK;
-} 
\ No newline at end of file
+    // Uses the last debounced state, so checking doesn't count as a sample
+    return (button_state & N64_RESET_MASK) == N64_RESET_MASK;
+}
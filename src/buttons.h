@@ -26,6 +26,7 @@
 // Function prototypes
 void buttons_init(void);
 uint16_t buttons_read(void);
+uint16_t buttons_read_raw(void);
 bool buttons_is_reset_pressed(void);
 
 #endif // BUTTONS_H 
\ No newline at end of file
@@ -4,6 +4,14 @@
 // N64 Protocol Pin Configuration
 #define N64_DATA_PIN 0
 
+// Multi-port mode: one board answers on up to 4 controller ports, each with its
+// own state machine, controller state and pak. Every port mirrors the local
+// inputs unless the firmware feeds it something else.
+#define N64_PORT_COUNT 1
+#define N64_PORT2_DATA_PIN 1
+#define N64_PORT3_DATA_PIN 20
+#define N64_PORT4_DATA_PIN 21
+
 // N64 Stick Encoder Pin Configuration
 #define ENCODER_Y1_PIN 2  // Y-axis encoder A
 #define ENCODER_Y0_PIN 3  // Y-axis encoder B
@@ -34,10 +42,19 @@
 #define N64_CONTROLLER_ID_LOW  0x00
 
 // Stick Configuration
-#define STICK_DEADZONE 2
-#define STICK_MAX_VALUE 127
-#define STICK_MIN_VALUE -128
-#define ENCODER_SCALE_FACTOR 4  // Each encoder step represents 4 controller units
+// Scaling, deadzone, response curve and gate come from a stick profile
+// (tools/stick_profiles), compiled into lookup tables; pick one with
+// cmake -DSTICK_PROFILE=<path>
+
+// Sample buttons and stick when a POLL arrives instead of using the last
+// 1ms update (which keeps running as a fallback)
+#define N64_JIT_POLL_SAMPLING 1
+
+// System Clock Configuration
+// 125000 (default), 133000, 200000 or 250000 kHz; the PIO bit timing is derived
+// from clk_sys, so only the CPU side of the reply path gets faster. Above
+// 133MHz the core voltage is raised before switching.
+#define SYS_CLOCK_KHZ 125000
 
 // Timing Configuration (in microseconds)
 #define N64_BIT_PERIOD_US 4
@@ -49,21 +66,65 @@
 #define N64_STOP_CONSOLE_HIGH_US 2
 #define N64_STOP_CONTROLLER_LOW_US 2
 #define N64_STOP_CONTROLLER_HIGH_US 1
+#define N64_REPLY_DEADLINE_US 100       // From the console stop bit; later frames get no reply
 
 // PIO Configuration
 #define N64_PIO pio0
-#define N64_PIO_SM 0
+#define N64_PIO_IRQ PIO0_IRQ_0  // Wakes core 1 when a frame is complete
+// Port n uses state machine n of N64_PIO and two DMA channels
+
+// Stick quadrature decoders (second PIO block)
+#define ENCODER_PIO pio1
+#define ENCODER_X_PIO_SM 0
+#define ENCODER_Y_PIO_SM 1
+
+// Report the stick where it is at poll time, extrapolated from the timing of
+// the last few encoder edges, rather than at the last edge
+#define ENCODER_EXTRAPOLATION 1
+#define ENCODER_VELOCITY_EDGES 4          // Edges averaged for the speed estimate
+#define ENCODER_VELOCITY_WINDOW_US 50000  // Slower than this over those edges counts as still
+
+// Joybus Statistics
+// Reply latency histograms per command, bus health counters and the last
+// transaction per port are always collected. With STATS_CONSOLE_ENABLE they
+// can be read over USB serial: send 's' for a report, 'r' to reset.
+#define N64_LATENCY_BIN_NS 500
+#define N64_LATENCY_BINS 32
+#define STATS_CONSOLE_ENABLE 1
 
 // Debug Configuration
 #define DEBUG_ENABLE 1
+#define DEBUG_UART uart0
+#define DEBUG_UART_TX_PIN 28       // Not GP0/GP1, the default stdio pins carry Joybus data
 #define DEBUG_UART_BAUD 115200
+#define EVENT_LOG_SIZE 128         // Records per core (power of two), 16 bytes each
+#define EVENT_LOG_POLLS 0          // Also log POLL commands and replies (thousands per second)
 
 // Controller Pak Configuration
 #define CONTROLLER_PAK_SIZE 32768  // 32KB
 #define CONTROLLER_PAK_PAGE_SIZE 32
 #define CONTROLLER_PAK_PAGES (CONTROLLER_PAK_SIZE / CONTROLLER_PAK_PAGE_SIZE)
+#define CONTROLLER_PAK_XIP_READS 1        // Read the pak from flash, keep only unsaved pages in RAM
+#define CONTROLLER_PAK_OVERLAY_PAGES 192  // RAM pages for unsaved writes, shared by all ports (XIP reads only)
 
 // Flash Storage Configuration
+#ifndef FLASH_STORAGE_OFFSET
 #define FLASH_STORAGE_OFFSET (1024 * 1024)  // 1MB offset from start of flash
+#endif
+#define FLASH_STORAGE_SECTORS (32 * N64_PORT_COUNT)  // 128KB wear-leveled log per pak image
+
+// Low Power
+// With no Joybus frames for POWER_IDLE_MS (console off or unplugged), core 0
+// gates unused clocks and sleeps until a data line moves
+#define POWER_SLEEP_ENABLE 1
+#define POWER_IDLE_MS 2000
+
+// Flash Scheduling (pak saves run on core 0 between console polls)
+#define PAK_SAVE_DELAY_MS 1000         // Batch pak writes for up to this long before saving
+#define PAK_FLASH_PROGRAM_US 1000      // Programming one 256-byte log block
+#define PAK_FLASH_ERASE_US 50000       // Erasing one 4KB sector
+#define N64_CONSOLE_IDLE_US 100000     // No frames for this long: console isn't polling
+#define N64_IDLE_SETTLE_US 500         // Quiet time after the last frame before flash work
+#define N64_IDLE_GUARD_US 1000         // Margin kept before the next expected poll
 
 #endif // CONFIG_H 
\ No newline at end of file
@@ -1,34 +1,570 @@
 #include "controller_pak.h"
+#include "joybus.h"
 #include "config.h"
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "n64_protocol.h"
+#include "event_log.h"
+#include <stddef.h>
 #include <string.h>
 
+// Every port has its own pak. Internally they are one store of
+// N64_PORT_COUNT banks: page n of port p is store page p * CONTROLLER_PAK_PAGES + n,
+// so all banks share one log, overlay and save schedule.
+#define PAK_TOTAL_SIZE  (N64_PORT_COUNT * CONTROLLER_PAK_SIZE)
+#define PAK_TOTAL_PAGES (N64_PORT_COUNT * CONTROLLER_PAK_PAGES)
+
+#if !CONTROLLER_PAK_XIP_READS
 // Controller pak data in RAM
-static uint8_t controller_pak_data[CONTROLLER_PAK_SIZE];
+static uint8_t controller_pak_data[PAK_TOTAL_SIZE];
+#endif
+
 static bool pak_present = true;
 static bool pak_initialized = false;
+static bool pak_ready = false;      // Loaded; set last, core 1 may access the pak from then on
 static bool pak_dirty = false;
 
-// Flash storage address (must be sector-aligned)
-#define FLASH_PAK_SECTOR (FLASH_STORAGE_OFFSET / FLASH_SECTOR_SIZE)
+// CRC of every 32-byte block, kept in sync on every write so READ replies
+// don't have to compute it between receiving the address and replying
+static uint8_t block_crc[PAK_TOTAL_PAGES];
+
+// Flash log
+//
+// The storage region is a circular log of 256-byte flash pages ("log blocks"),
+// each holding up to 7 pak pages plus a header with a sequence number. Saving
+// appends only the dirty pak pages, so save time scales with what changed and
+// erases walk around the whole region instead of hitting one sector. When free
+// space runs low the oldest sector is compacted: pages whose latest copy still
+// lives there are rewritten at the head and the sector is erased. At boot the
+// log is replayed oldest to newest to rebuild the image.
+#define PAK_LOG_MAGIC             0x4B415036u  // "6PAK"
+#define PAK_LOG_SLOTS             7            // Pak pages per log block
+#define PAK_LOG_BLOCKS_PER_SECTOR (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define PAK_LOG_BLOCKS            (FLASH_STORAGE_SECTORS * PAK_LOG_BLOCKS_PER_SECTOR)
+#define PAK_LOG_RESERVE_SECTORS   2            // Erased sectors needed to enter a new one
+#define PAK_LOG_IMAGE_SECTORS     ((CONTROLLER_PAK_PAGES + PAK_LOG_SLOTS * PAK_LOG_BLOCKS_PER_SECTOR - 1) / \
+                                   (PAK_LOG_SLOTS * PAK_LOG_BLOCKS_PER_SECTOR))  // One whole pak rewritten
+// Start freeing the oldest sector below this. Erases only run while the
+// console is quiet, so the log keeps room for a game to rewrite a whole pak
+// while it polls.
+#define PAK_LOG_LOW_WATER_SECTORS (PAK_LOG_RESERVE_SECTORS + PAK_LOG_IMAGE_SECTORS)
+#define PAK_LOG_FLAG_NO_LEGACY    0x1          // Cleared in blocks written while a legacy image is imported
+
+// Where the latest copy of a pak page lives: log block and slot
+#define PAK_LOCATION(block, slot) ((uint16_t)(((block) << 3) | (slot)))
+#define PAK_LOCATION_NONE         0xFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;                  // Increases with every block written
+    uint16_t pages[PAK_LOG_SLOTS];      // Pak page held in each slot
+    uint16_t count;                     // Slots in use
+    uint32_t flags;                     // PAK_LOG_FLAG_*, erased (all set) by default
+    uint32_t checksum;                  // Over the whole block except this field
+    uint8_t data[PAK_LOG_SLOTS][CONTROLLER_PAK_PAGE_SIZE];
+} pak_log_block_t;
+
+_Static_assert(sizeof(pak_log_block_t) == FLASH_PAGE_SIZE, "Log block must fill one flash page");
+_Static_assert(FLASH_STORAGE_OFFSET % FLASH_SECTOR_SIZE == 0, "Flash storage must be sector-aligned");
+_Static_assert(FLASH_STORAGE_SECTORS >= PAK_LOG_LOW_WATER_SECTORS +
+               (PAK_TOTAL_PAGES / PAK_LOG_SLOTS) / PAK_LOG_BLOCKS_PER_SECTOR + 2,
+               "Flash storage too small for every pak image plus compaction space");
+_Static_assert(PAK_LOCATION(PAK_LOG_BLOCKS - 1, PAK_LOG_SLOTS - 1) < PAK_LOCATION_NONE,
+               "Log too large for 16-bit page locations");
+_Static_assert(FLASH_STORAGE_OFFSET + FLASH_STORAGE_SECTORS * FLASH_SECTOR_SIZE <= PICO_FLASH_SIZE_BYTES,
+               "Flash storage runs past the end of flash");
+
+static uint16_t page_location[PAK_TOTAL_PAGES];
+static uint16_t sector_live[FLASH_STORAGE_SECTORS];    // Pages whose latest copy is in each sector
+static uint32_t dirty_pages[PAK_TOTAL_PAGES / 32];
+static uint32_t log_head = 0;       // Next block to write
+static uint32_t log_tail = 0;       // First block of the oldest sector in use
+static uint32_t log_sequence = 0;
+static bool log_evacuating = false; // Live pages of the tail sector are being moved out
+static pak_log_block_t log_buffer;
+static uint32_t dirty_since_ms = 0;  // When the oldest unsaved write arrived
+
+// Raw image left by older firmware at the start of the region, read while it
+// is being copied into the log
+static const uint8_t* legacy_image = NULL;
+
+static const uint8_t zero_page[CONTROLLER_PAK_PAGE_SIZE];
+
+#if CONTROLLER_PAK_XIP_READS
+// Write overlay
+//
+// Clean pages are read straight from their latest copy in the XIP-mapped log,
+// so only pages written since the last save need RAM. Core 1 takes a slot for
+// a page on its first write; core 0 hands the slot back once the page is in
+// flash. Slots return through a second SPSC queue (core 0 to core 1), and
+// page_location/overlay_index only change while core 1 is parked, so core 1
+// never sees them half-updated.
+#define PAK_OVERLAY_NONE 0xFF
+#define PAK_OVERLAY_QUEUE_SIZE 256
+
+_Static_assert(CONTROLLER_PAK_OVERLAY_PAGES < PAK_OVERLAY_NONE, "Overlay slots must fit in a byte");
+_Static_assert(CONTROLLER_PAK_OVERLAY_PAGES <= PAK_OVERLAY_QUEUE_SIZE, "Free slot queue too small");
+
+static uint8_t overlay_data[CONTROLLER_PAK_OVERLAY_PAGES][CONTROLLER_PAK_PAGE_SIZE];
+static uint8_t overlay_index[PAK_TOTAL_PAGES];          // Slot holding each page
+static uint8_t overlay_free[PAK_OVERLAY_QUEUE_SIZE];
+static uint32_t overlay_free_head = 0;                  // Written by core 0
+static uint32_t overlay_free_tail = 0;                  // Written by core 1
+static uint32_t overlay_writing = PAK_LOCATION_NONE;    // Page core 1 is writing
+#endif
+
+// Dirty page queue
+//
+// WRITE commands are handled on core 1, which only updates the RAM image and
+// posts the page number here. Core 0 drains the queue and does all flash work
+// between console polls. Single producer, single consumer: core 1 only writes
+// the head, core 0 only writes the tail. If the queue ever fills, core 1 sets
+// the overflow flag and core 0 finds the dirty pages by comparing RAM to flash.
+#define PAK_DIRTY_QUEUE_SIZE 64
+
+_Static_assert((PAK_DIRTY_QUEUE_SIZE & (PAK_DIRTY_QUEUE_SIZE - 1)) == 0, "Queue size must be a power of two");
+
+static uint16_t dirty_queue[PAK_DIRTY_QUEUE_SIZE];
+static uint32_t dirty_queue_head = 0;
+static uint32_t dirty_queue_tail = 0;
+static bool dirty_queue_overflow = false;
+
+// Core 1: post a page written by the console
+static void __not_in_flash_func(pak_queue_push)(uint16_t page) {
+    uint32_t head = __atomic_load_n(&dirty_queue_head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&dirty_queue_tail, __ATOMIC_ACQUIRE);
+    
+    if (head - tail == PAK_DIRTY_QUEUE_SIZE) {
+        __atomic_store_n(&dirty_queue_overflow, true, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    dirty_queue[head % PAK_DIRTY_QUEUE_SIZE] = page;
+    __atomic_store_n(&dirty_queue_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void pak_mark_dirty(uint32_t page) {
+    dirty_pages[page / 32] |= 1u << (page % 32);
+    pak_dirty = true;
+}
+
+static inline void pak_clear_dirty(uint32_t page) {
+    dirty_pages[page / 32] &= ~(1u << (page % 32));
+}
+
+static inline bool pak_is_dirty(uint32_t page) {
+    return dirty_pages[page / 32] & (1u << (page % 32));
+}
+
+static inline const pak_log_block_t* pak_log_block(uint32_t block) {
+    return (const pak_log_block_t*)(XIP_BASE + FLASH_STORAGE_OFFSET + block * FLASH_PAGE_SIZE);
+}
+
+static inline uint32_t pak_location_sector(uint16_t location) {
+    return (location >> 3) / PAK_LOG_BLOCKS_PER_SECTOR;
+}
+
+// Record where the latest copy of a page lives, keeping the per-sector counts
+static void pak_set_location(uint32_t page, uint16_t location) {
+    if (page_location[page] != PAK_LOCATION_NONE) {
+        sector_live[pak_location_sector(page_location[page])]--;
+    }
+    if (location != PAK_LOCATION_NONE) {
+        sector_live[pak_location_sector(location)]++;
+    }
+    page_location[page] = location;
+}
+
+// Latest contents of a page, wherever they live
+static const uint8_t* __not_in_flash_func(pak_page_data)(uint32_t page) {
+#if CONTROLLER_PAK_XIP_READS
+    uint8_t slot = overlay_index[page];
+    if (slot != PAK_OVERLAY_NONE) {
+        return overlay_data[slot];
+    }
+    
+    uint16_t location = page_location[page];
+    if (location != PAK_LOCATION_NONE) {
+        return pak_log_block(location >> 3)->data[location & 7];
+    }
+    // The legacy image only ever held the first port's pak
+    return legacy_image && page < CONTROLLER_PAK_PAGES ? &legacy_image[page * CONTROLLER_PAK_PAGE_SIZE] : zero_page;
+#else
+    return &controller_pak_data[page * CONTROLLER_PAK_PAGE_SIZE];
+#endif
+}
+
+#if CONTROLLER_PAK_XIP_READS
+// Core 0, with core 1 parked: give back the slot of a page now saved in flash
+static void pak_overlay_release(uint32_t page) {
+    uint8_t slot = overlay_index[page];
+    
+    if (slot == PAK_OVERLAY_NONE) {
+        return;
+    }
+    
+    // Core 1 was stopped in the middle of writing this page, keep it in RAM
+    // until it has been saved complete
+    if (overlay_writing == page) {
+        pak_mark_dirty(page);
+        return;
+    }
+    
+    overlay_index[page] = PAK_OVERLAY_NONE;
+    overlay_free[overlay_free_head % PAK_OVERLAY_QUEUE_SIZE] = slot;
+    __atomic_store_n(&overlay_free_head, overlay_free_head + 1, __ATOMIC_RELEASE);
+}
+
+// Core 1: RAM copy of a page about to be written, NULL when the overlay is full
+static uint8_t* __not_in_flash_func(pak_overlay_acquire)(uint32_t page) {
+    uint8_t slot = overlay_index[page];
+    if (slot != PAK_OVERLAY_NONE) {
+        return overlay_data[slot];
+    }
+    
+    uint32_t tail = overlay_free_tail;
+    if (tail == __atomic_load_n(&overlay_free_head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    slot = overlay_free[tail % PAK_OVERLAY_QUEUE_SIZE];
+    __atomic_store_n(&overlay_free_tail, tail + 1, __ATOMIC_RELAXED);
+    
+    // Start from the saved contents, the write may cover only part of the page
+    memcpy(overlay_data[slot], pak_page_data(page), CONTROLLER_PAK_PAGE_SIZE);
+    overlay_index[page] = slot;
+    return overlay_data[slot];
+}
+
+static uint32_t pak_overlay_used(void) {
+    return CONTROLLER_PAK_OVERLAY_PAGES -
+           (__atomic_load_n(&overlay_free_head, __ATOMIC_RELAXED) -
+            __atomic_load_n(&overlay_free_tail, __ATOMIC_RELAXED));
+}
+
+// Drop every page from the overlay (core 1 not running)
+static void pak_overlay_reset(void) {
+    memset(overlay_index, PAK_OVERLAY_NONE, sizeof(overlay_index));
+    for (uint32_t slot = 0; slot < CONTROLLER_PAK_OVERLAY_PAGES; slot++) {
+        overlay_free[slot] = slot;
+    }
+    overlay_free_tail = 0;
+    overlay_free_head = CONTROLLER_PAK_OVERLAY_PAGES;
+}
+#endif
+
+// FNV-1a over the block with the checksum field skipped
+static uint32_t pak_log_checksum(const pak_log_block_t* block) {
+    const uint8_t* bytes = (const uint8_t*)block;
+    uint32_t hash = 0x811C9DC5u;
+    
+    for (size_t i = 0; i < sizeof(pak_log_block_t); i++) {
+        if (i == offsetof(pak_log_block_t, checksum)) {
+            i += sizeof(block->checksum) - 1;
+            continue;
+        }
+        hash = (hash ^ bytes[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+static bool pak_log_block_valid(const pak_log_block_t* block) {
+    return block->magic == PAK_LOG_MAGIC &&
+           block->count <= PAK_LOG_SLOTS &&
+           block->checksum == pak_log_checksum(block);
+}
+
+static bool pak_flash_is_erased(uint32_t offset, size_t length) {
+    const uint32_t* words = (const uint32_t*)(XIP_BASE + offset);
+    
+    for (size_t i = 0; i < length / sizeof(uint32_t); i++) {
+        if (words[i] != 0xFFFFFFFFu) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// XIP is unavailable while flash is busy, so once core 1 is running it is
+// parked in RAM for the duration (it has to have called
+// multicore_lockout_victim_init()). The protocol is told, so frames that
+// arrive meanwhile aren't answered after the console has given up on them.
+static uint32_t pak_flash_begin(void) {
+    if (multicore_lockout_victim_is_initialized(1)) {
+        multicore_lockout_start_blocking();
+        n64_protocol_park_begin();
+    }
+    return save_and_disable_interrupts();
+}
+
+static void pak_flash_end(uint32_t interrupts) {
+    restore_interrupts(interrupts);
+    if (multicore_lockout_victim_is_initialized(1)) {
+        n64_protocol_park_end();
+        multicore_lockout_end_blocking();
+    }
+}
+
+static void pak_flash_erase_sector(uint32_t sector) {
+    uint32_t offset = FLASH_STORAGE_OFFSET + sector * FLASH_SECTOR_SIZE;
+    
+    uint32_t interrupts = pak_flash_begin();
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    pak_flash_end(interrupts);
+    
+    event_log_write(EVENT_PAK_ERASE, 0, 0, sector, 0);
+}
+
+// Snapshot the given pages into a log block, program it at the head and point
+// the pages at their new copies
+static void pak_flash_program_pages(const uint16_t* pages, uint32_t count) {
+    uint32_t offset = FLASH_STORAGE_OFFSET + log_head * FLASH_PAGE_SIZE;
+    event_log_write(EVENT_PAK_SAVE, 0, 0, log_head, count);
+    
+    memset(&log_buffer, 0xFF, sizeof(log_buffer));
+    log_buffer.magic = PAK_LOG_MAGIC;
+    log_buffer.sequence = log_sequence++;
+    log_buffer.count = count;
+    if (legacy_image) {
+        log_buffer.flags &= ~PAK_LOG_FLAG_NO_LEGACY;
+    }
+    
+    uint32_t interrupts = pak_flash_begin();
+    
+    // Copied with core 1 parked; a page it was halfway through writing has
+    // been queued again and will be saved once more
+    for (uint32_t slot = 0; slot < count; slot++) {
+        log_buffer.pages[slot] = pages[slot];
+        memcpy(log_buffer.data[slot], pak_page_data(pages[slot]), CONTROLLER_PAK_PAGE_SIZE);
+    }
+    log_buffer.checksum = pak_log_checksum(&log_buffer);
+    
+    flash_range_program(offset, (const uint8_t*)&log_buffer, FLASH_PAGE_SIZE);
+    
+    // Still parked: core 1 looks pages up through these
+    for (uint32_t slot = 0; slot < count; slot++) {
+        pak_set_location(pages[slot], PAK_LOCATION(log_head, slot));
+        pak_clear_dirty(pages[slot]);
+#if CONTROLLER_PAK_XIP_READS
+        pak_overlay_release(pages[slot]);
+#endif
+    }
+    log_head = (log_head + 1) % PAK_LOG_BLOCKS;
+    
+    pak_flash_end(interrupts);
+}
+
+// Sectors not holding live log data (all of them are kept erased)
+static uint32_t pak_log_free_sectors(void) {
+    uint32_t used_blocks = (log_head + PAK_LOG_BLOCKS - log_tail) % PAK_LOG_BLOCKS;
+    uint32_t used_sectors = (used_blocks + PAK_LOG_BLOCKS_PER_SECTOR - 1) / PAK_LOG_BLOCKS_PER_SECTOR;
+    return FLASH_STORAGE_SECTORS - used_sectors;
+}
+
+// The head may enter a new sector only while another erased one remains,
+// so it never runs into the tail
+static bool pak_log_can_append(void) {
+    return log_head % PAK_LOG_BLOCKS_PER_SECTOR != 0 ||
+           pak_log_free_sectors() >= PAK_LOG_RESERVE_SECTORS;
+}
+
+// Write one log block holding up to 7 dirty pages. While the tail sector is
+// being evacuated its pages go first, so evacuation never waits behind new
+// saves for space.
+static bool pak_log_append_dirty(void) {
+    uint16_t batch[PAK_LOG_SLOTS];
+    uint32_t count = 0;
+    uint32_t tail_sector = log_tail / PAK_LOG_BLOCKS_PER_SECTOR;
+    bool tail_first = log_evacuating && sector_live[tail_sector] > 0;
+    
+    for (uint32_t page = 0; page < PAK_TOTAL_PAGES && count < PAK_LOG_SLOTS; page++) {
+        if (!pak_is_dirty(page)) {
+            continue;
+        }
+        if (tail_first && (page_location[page] == PAK_LOCATION_NONE ||
+                           pak_location_sector(page_location[page]) != tail_sector)) {
+            continue;
+        }
+        batch[count++] = page;
+    }
+    
+    if (count == 0) {
+        pak_dirty = false;
+        return false;
+    }
+    
+    pak_flash_program_pages(batch, count);
+    
+    // Once everything is saved, the next write waits out the save delay again
+    // instead of going out in a block of its own
+    pak_dirty = false;
+    for (uint32_t i = 0; i < PAK_TOTAL_PAGES / 32; i++) {
+        if (dirty_pages[i]) {
+            pak_dirty = true;
+            break;
+        }
+    }
+    return true;
+}
+
+// Start moving the live pages out of the oldest sector once free space runs
+// low. They are simply marked dirty, and the next appends copy them from
+// wherever pak_page_data() finds them: RAM, the overlay, or their copy in this
+// very sector, which stays readable because it is only erased once
+// sector_live says nothing in it is the latest copy any more.
+static void pak_log_evacuate_tail(void) {
+    uint32_t tail_sector = log_tail / PAK_LOG_BLOCKS_PER_SECTOR;
+    
+    for (uint32_t page = 0; page < PAK_TOTAL_PAGES; page++) {
+        if (page_location[page] != PAK_LOCATION_NONE &&
+            pak_location_sector(page_location[page]) == tail_sector) {
+            pak_mark_dirty(page);
+        }
+    }
+    log_evacuating = true;
+}
+
+// Erase the evacuated tail sector, freeing it for the head
+static void pak_log_erase_tail(void) {
+    pak_flash_erase_sector(log_tail / PAK_LOG_BLOCKS_PER_SECTOR);
+    log_tail = (log_tail + PAK_LOG_BLOCKS_PER_SECTOR) % PAK_LOG_BLOCKS;
+    log_evacuating = false;
+}
+
+// Do the next pending flash operation if the caller allows it.
+// Returns true if flash was touched.
+static bool pak_log_step(bool program_allowed, bool erase_allowed) {
+    if (!log_evacuating && pak_log_free_sectors() < PAK_LOG_LOW_WATER_SECTORS) {
+        pak_log_evacuate_tail();
+    }
+    
+    if (log_evacuating && sector_live[log_tail / PAK_LOG_BLOCKS_PER_SECTOR] == 0) {
+        if (erase_allowed) {
+            pak_log_erase_tail();
+            return true;
+        }
+    }
+    
+    if (pak_dirty && program_allowed && pak_log_can_append()) {
+        return pak_log_append_dirty();
+    }
+    
+    return false;
+}
+
+// Erase the whole region and start an empty log
+static void pak_log_reset(void) {
+    for (uint32_t sector = 0; sector < FLASH_STORAGE_SECTORS; sector++) {
+        if (!pak_flash_is_erased(FLASH_STORAGE_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) {
+            pak_flash_erase_sector(sector);
+        }
+    }
+    
+    for (uint32_t page = 0; page < PAK_TOTAL_PAGES; page++) {
+        page_location[page] = PAK_LOCATION_NONE;
+    }
+    memset(sector_live, 0, sizeof(sector_live));
+    log_head = 0;
+    log_tail = 0;
+    log_evacuating = false;
+}
+
+// Core 0: move queued page numbers into the dirty bitmap
+static void pak_queue_drain(void) {
+    bool overflow = __atomic_exchange_n(&dirty_queue_overflow, false, __ATOMIC_ACQUIRE);
+    uint32_t head = __atomic_load_n(&dirty_queue_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = dirty_queue_tail;
+    
+    if (head == tail && !overflow) {
+        return;
+    }
+    
+    if (!pak_dirty) {
+        dirty_since_ms = to_ms_since_boot(get_absolute_time());
+    }
+    
+    for (; tail != head; tail++) {
+        pak_mark_dirty(dirty_queue[tail % PAK_DIRTY_QUEUE_SIZE]);
+    }
+    __atomic_store_n(&dirty_queue_tail, tail, __ATOMIC_RELEASE);
+    
+    // Some pages were dropped - find them again
+    if (overflow) {
+        for (uint32_t page = 0; page < PAK_TOTAL_PAGES; page++) {
+#if CONTROLLER_PAK_XIP_READS
+            // Every page in the overlay is unsaved
+            if (overlay_index[page] != PAK_OVERLAY_NONE) {
+                pak_mark_dirty(page);
+            }
+#else
+            // Compare against the saved copy
+            uint16_t location = page_location[page];
+            const uint8_t* saved = location == PAK_LOCATION_NONE ? zero_page :
+                                   pak_log_block(location >> 3)->data[location & 7];
+            
+            if (memcmp(&controller_pak_data[page * CONTROLLER_PAK_PAGE_SIZE], saved,
+                       CONTROLLER_PAK_PAGE_SIZE) != 0) {
+                pak_mark_dirty(page);
+            }
+#endif
+        }
+    }
+}
+
+// Offset of a pak address in the store of all ports
+static inline uint32_t pak_store_address(uint8_t port, uint16_t address) {
+    return (uint32_t)port * CONTROLLER_PAK_SIZE + address;
+}
+
+// Recompute the cached CRC of every block touched by store range [address, address + length)
+static void __not_in_flash_func(controller_pak_update_crc)(uint32_t address, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    
+    uint32_t first = address / CONTROLLER_PAK_PAGE_SIZE;
+    uint32_t last = (address + length - 1) / CONTROLLER_PAK_PAGE_SIZE;
+    
+    for (uint32_t page = first; page <= last; page++) {
+        block_crc[page] = calculate_crc(pak_page_data(page), CONTROLLER_PAK_PAGE_SIZE);
+    }
+}
 
 bool controller_pak_init(void) {
+#if CONTROLLER_PAK_XIP_READS
+    // Pages are read from flash, nothing to copy
+    pak_overlay_reset();
+#else
     // Initialize pak data to zeros
-    memset(controller_pak_data, 0, CONTROLLER_PAK_SIZE);
+    memset(controller_pak_data, 0, PAK_TOTAL_SIZE);
+#endif
+    // Nothing carries over from before: everything is rebuilt from flash, so
+    // running this again acts like a reset
+    memset(dirty_pages, 0, sizeof(dirty_pages));
+    dirty_queue_head = 0;
+    dirty_queue_tail = 0;
+    dirty_queue_overflow = false;
+    pak_dirty = false;
+    log_evacuating = false;
+    log_sequence = 0;
+    legacy_image = NULL;
+    
+    pak_initialized = true;
+    pak_present = true;
     
     // Try to load existing data from flash
     controller_pak_load_from_flash();
+    controller_pak_update_crc(0, PAK_TOTAL_SIZE);
     
-    pak_initialized = true;
-    pak_present = true;
+    // Core 1 starts answering before this has run; it reports no pak until now
+    __atomic_store_n(&pak_ready, true, __ATOMIC_RELEASE);
     
     return true;
 }
 
-void controller_pak_read(uint16_t address, uint8_t* data, size_t length) {
-    if (!pak_present || !pak_initialized) {
+void __not_in_flash_func(controller_pak_read)(uint8_t port, uint16_t address, uint8_t* data, size_t length) {
+    if (!pak_present || !controller_pak_is_ready() || port >= N64_PORT_COUNT) {
         // No pak present - return zeros
         memset(data, 0, length);
         return;
@@ -45,18 +581,42 @@ void controller_pak_read(uint16_t address, uint8_t* data, size_t length) {
         length = CONTROLLER_PAK_SIZE - address;
     }
     
+    uint32_t store = pak_store_address(port, address);
+    
+#if CONTROLLER_PAK_XIP_READS
+    // Copy page by page from the overlay or flash
+    while (length > 0) {
+        uint32_t offset = store % CONTROLLER_PAK_PAGE_SIZE;
+        size_t chunk = CONTROLLER_PAK_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        
+        memcpy(data, pak_page_data(store / CONTROLLER_PAK_PAGE_SIZE) + offset, chunk);
+        store += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+#else
     // Copy data from pak memory
-    memcpy(data, &controller_pak_data[address], length);
+    memcpy(data, &controller_pak_data[store], length);
+#endif
 }
 
-void controller_pak_write(uint16_t address, const uint8_t* data, size_t length) {
-    if (!pak_present || !pak_initialized) {
-        return;
+uint8_t __not_in_flash_func(controller_pak_read_crc)(uint8_t port, uint16_t address) {
+    // Missing pak or out of range reads return zeros, whose CRC is 0
+    if (!pak_present || !controller_pak_is_ready() || port >= N64_PORT_COUNT || address >= CONTROLLER_PAK_SIZE) {
+        return 0;
     }
     
+    return block_crc[pak_store_address(port, address) / CONTROLLER_PAK_PAGE_SIZE];
+}
+
+// Store a write in a port's pak, false if it couldn't be kept
+static bool __not_in_flash_func(pak_write)(uint8_t port, uint16_t address, const uint8_t* data, size_t length) {
     // Ensure address is within bounds
-    if (address >= CONTROLLER_PAK_SIZE) {
-        return;
+    if (port >= N64_PORT_COUNT || address >= CONTROLLER_PAK_SIZE || length == 0) {
+        return true;
     }
     
     // Limit length to available space
@@ -64,92 +624,305 @@ void controller_pak_write(uint16_t address, const uint8_t* data, size_t length)
         length = CONTROLLER_PAK_SIZE - address;
     }
     
+    uint32_t store = pak_store_address(port, address);
+    
+#if CONTROLLER_PAK_XIP_READS
+    // Copy into the overlay page by page
+    while (length > 0) {
+        uint32_t page = store / CONTROLLER_PAK_PAGE_SIZE;
+        uint32_t offset = store % CONTROLLER_PAK_PAGE_SIZE;
+        size_t chunk = CONTROLLER_PAK_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        
+        __atomic_store_n(&overlay_writing, page, __ATOMIC_SEQ_CST);
+        uint8_t* copy = pak_overlay_acquire(page);
+        if (!copy) {
+            // Core 0 hasn't caught up saving - fail the write rather than lose it
+            __atomic_store_n(&overlay_writing, PAK_LOCATION_NONE, __ATOMIC_RELEASE);
+            return false;
+        }
+        memcpy(copy + offset, data, chunk);
+        controller_pak_update_crc(store, chunk);
+        
+        // Core 0 saves the page to flash between polls
+        pak_queue_push(page);
+        __atomic_store_n(&overlay_writing, PAK_LOCATION_NONE, __ATOMIC_RELEASE);
+        
+        store += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+#else
     // Copy data to pak memory
-    memcpy(&controller_pak_data[address], data, length);
+    memcpy(&controller_pak_data[store], data, length);
+    controller_pak_update_crc(store, length);
     
-    // Mark as dirty for later flash save
-    pak_dirty = true;
+    // Core 0 saves the touched pages to flash between polls
+    for (uint32_t page = store / CONTROLLER_PAK_PAGE_SIZE;
+         page <= (store + length - 1) / CONTROLLER_PAK_PAGE_SIZE; page++) {
+        pak_queue_push(page);
+    }
+#endif
     
-    // Save to flash after a delay (to batch writes)
-    // This would be better implemented with a timer
-    static uint32_t last_write_time = 0;
-    uint32_t current_time = to_ms_since_boot(get_absolute_time());
+    return true;
+}
+
+bool __not_in_flash_func(controller_pak_write)(uint8_t port, uint16_t address, const uint8_t* data, size_t length) {
+    if (!pak_present) {
+        return true;
+    }
     
-    if (current_time - last_write_time > 1000) { // 1 second delay
-        controller_pak_save_to_flash();
-        last_write_time = current_time;
+    // Still loading - the console was told there is no pak
+    if (!controller_pak_is_ready()) {
+        return false;
     }
+    
+    return pak_write(port, address, data, length);
+}
+
+// Write the identification pattern at the start of a port's pak
+static void pak_write_id(uint8_t port) {
+    static const uint8_t pak_id[] = { 0x81, 0x80, 0x80, 0x80 }; // Controller pak ID
+    pak_write(port, 0, pak_id, sizeof(pak_id));
 }
 
+// Format the paks of every port
 void controller_pak_format(void) {
     if (!pak_initialized) {
         return;
     }
     
-    // Clear all data
-    memset(controller_pak_data, 0, CONTROLLER_PAK_SIZE);
+    // Start a fresh log: every page reads back as zeros
+    pak_log_reset();
+    memset(dirty_pages, 0, sizeof(dirty_pages));
+    pak_dirty = false;
+#if CONTROLLER_PAK_XIP_READS
+    pak_overlay_reset();
+#else
+    memset(controller_pak_data, 0, PAK_TOTAL_SIZE);
+#endif
+    controller_pak_update_crc(0, PAK_TOTAL_SIZE);
     
     // Set up basic controller pak structure
     // Note header area (first 256 bytes typically contain formatting info)
     // This is a simplified format - real N64 controller paks have a more complex structure
     
     // Write identification pattern
-    controller_pak_data[0] = 0x81; // Controller pak ID
-    controller_pak_data[1] = 0x80;
-    controller_pak_data[2] = 0x80;
-    controller_pak_data[3] = 0x80;
-    
-    pak_dirty = true;
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        pak_write_id(port);
+    }
     controller_pak_save_to_flash();
 }
 
-bool controller_pak_is_present(void) {
+bool __not_in_flash_func(controller_pak_is_present)(void) {
     return pak_present;
 }
 
+bool __not_in_flash_func(controller_pak_is_ready)(void) {
+    return __atomic_load_n(&pak_ready, __ATOMIC_ACQUIRE);
+}
+
+// Core 0: true while written pages still have to reach flash
+bool controller_pak_save_pending(void) {
+    if (!pak_initialized) {
+        return false;
+    }
+    
+    return pak_dirty ||
+           __atomic_load_n(&dirty_queue_head, __ATOMIC_ACQUIRE) != dirty_queue_tail ||
+           __atomic_load_n(&dirty_queue_overflow, __ATOMIC_ACQUIRE);
+}
+
+// Save everything now, regardless of console traffic (boot time)
 void controller_pak_save_to_flash(void) {
-    if (!pak_dirty || !pak_initialized) {
+    if (!pak_initialized) {
+        return;
+    }
+    
+    pak_queue_drain();
+    while (pak_log_step(true, true)) {
+    }
+}
+
+// Called from core 0: save queued pages without ever overlapping a Joybus
+// transaction. Programs go into the gap after a poll. Erases take longer than
+// a poll period, so they wait until the console goes quiet; the low-water
+// reserve keeps saves going until then, and should it run out anyway, saves
+// wait in RAM rather than cost polls.
+void controller_pak_task(void) {
+    if (!pak_initialized) {
         return;
     }
     
-    // Disable interrupts during flash operation
-    uint32_t interrupts = save_and_disable_interrupts();
+    pak_queue_drain();
     
-    // Erase the flash sector
-    flash_range_erase(FLASH_STORAGE_OFFSET, FLASH_SECTOR_SIZE);
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    bool save_due = pak_dirty && now - dirty_since_ms >= PAK_SAVE_DELAY_MS;
+#if CONTROLLER_PAK_XIP_READS
+    // Don't let the overlay fill up while batching
+    save_due |= pak_dirty && pak_overlay_used() >= CONTROLLER_PAK_OVERLAY_PAGES / 2;
+#endif
+    bool program_window = n64_protocol_idle_window(PAK_FLASH_PROGRAM_US);
+    bool erase_window = n64_protocol_idle_window(PAK_FLASH_ERASE_US);
     
-    // Write the controller pak data
-    // Flash can only be written in 256-byte pages
-    for (uint32_t offset = 0; offset < CONTROLLER_PAK_SIZE; offset += FLASH_PAGE_SIZE) {
-        flash_range_program(FLASH_STORAGE_OFFSET + offset, 
-                           &controller_pak_data[offset], 
-                           FLASH_PAGE_SIZE);
+    // One flash operation per call keeps the core 0 loop responsive
+    pak_log_step(save_due && program_window, erase_window);
+}
+
+// Images saved by older firmware
+//
+// An image saved by older firmware is one raw copy at the start of the region.
+// It is copied into the log, which starts right after it. Blocks written
+// during the copy are flagged as importing. Pages not copied yet still read
+// from the image. Only once every page is in the log is an unflagged (empty)
+// block written, and only after that is the image erased. A power cut at any
+// point before that leaves a newest block flagged as importing, and the next
+// boot resumes the copy from the image.
+#define PAK_LEGACY_SECTORS (CONTROLLER_PAK_SIZE / FLASH_SECTOR_SIZE)
+
+static bool pak_log_block_importing(const pak_log_block_t* block) {
+    return !(block->flags & PAK_LOG_FLAG_NO_LEGACY);
+}
+
+static void pak_legacy_open(void) {
+    legacy_image = (const uint8_t*)(XIP_BASE + FLASH_STORAGE_OFFSET);
+#if !CONTROLLER_PAK_XIP_READS
+    memcpy(controller_pak_data, legacy_image, CONTROLLER_PAK_SIZE);
+#endif
+}
+
+// Save the first port's pages that are still only in the image, format the
+// other ports, then mark the import done and erase the image
+static void pak_legacy_finish(void) {
+    for (uint32_t page = 0; page < CONTROLLER_PAK_PAGES; page++) {
+        if (page_location[page] == PAK_LOCATION_NONE) {
+            pak_mark_dirty(page);
+        }
     }
     
-    // Restore interrupts
-    restore_interrupts(interrupts);
+    // The image becomes the first port's pak, the others start out formatted
+    for (uint8_t port = 1; port < N64_PORT_COUNT; port++) {
+        pak_write_id(port);
+    }
+    controller_pak_save_to_flash();
     
-    pak_dirty = false;
+    // Every page is in the log now: the empty block without the importing flag
+    // is the completion marker
+    legacy_image = NULL;
+    pak_flash_program_pages(NULL, 0);
+    
+    for (uint32_t sector = 0; sector < PAK_LEGACY_SECTORS; sector++) {
+        if (!pak_flash_is_erased(FLASH_STORAGE_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) {
+            pak_flash_erase_sector(sector);
+        }
+    }
+}
+
+// Start copying an image found with no log next to it
+static void pak_log_import_legacy(void) {
+    pak_legacy_open();
+    
+    for (uint32_t sector = PAK_LEGACY_SECTORS; sector < FLASH_STORAGE_SECTORS; sector++) {
+        if (!pak_flash_is_erased(FLASH_STORAGE_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) {
+            pak_flash_erase_sector(sector);
+        }
+    }
+    log_head = PAK_LEGACY_SECTORS * PAK_LOG_BLOCKS_PER_SECTOR;
+    log_tail = log_head;
+    
+    pak_legacy_finish();
 }
 
 void controller_pak_load_from_flash(void) {
-    // Read controller pak data from flash
-    const uint8_t* flash_data = (const uint8_t*)(XIP_BASE + FLASH_STORAGE_OFFSET);
-    
-    // Check if flash contains valid data (not all 0xFF)
-    bool flash_empty = true;
-    for (int i = 0; i < 16; i++) {
-        if (flash_data[i] != 0xFF) {
-            flash_empty = false;
+    // Find the oldest and newest valid log blocks
+    bool found = false;
+    uint32_t oldest = 0, newest = 0;
+    
+    for (uint32_t block = 0; block < PAK_LOG_BLOCKS; block++) {
+        const pak_log_block_t* entry = pak_log_block(block);
+        if (!pak_log_block_valid(entry)) {
+            continue;
+        }
+    
+        if (!found || (int32_t)(entry->sequence - pak_log_block(oldest)->sequence) < 0) {
+            oldest = block;
+        }
+        if (!found || (int32_t)(entry->sequence - pak_log_block(newest)->sequence) > 0) {
+            newest = block;
+        }
+        found = true;
+    }
+    
+    for (uint32_t page = 0; page < PAK_TOTAL_PAGES; page++) {
+        page_location[page] = PAK_LOCATION_NONE;
+    }
+    memset(sector_live, 0, sizeof(sector_live));
+    
+    if (!found) {
+        if (!pak_flash_is_erased(FLASH_STORAGE_OFFSET, 16)) {
+            // Image saved by older firmware - migrate it to the log
+            pak_log_import_legacy();
+        } else {
+            // Flash is empty, format the pak
+            controller_pak_format();
+        }
+        return;
+    }
+    
+    // An import cut short: the image still backs the pages not copied yet
+    bool importing = pak_log_block_importing(pak_log_block(newest));
+    if (importing) {
+        pak_legacy_open();
+    }
+    
+    // Replay in write order, newer copies overwrite older ones
+    log_tail = oldest - oldest % PAK_LOG_BLOCKS_PER_SECTOR;
+    for (uint32_t block = log_tail; ; block = (block + 1) % PAK_LOG_BLOCKS) {
+        const pak_log_block_t* entry = pak_log_block(block);
+    
+        if (pak_log_block_valid(entry)) {
+            for (uint32_t slot = 0; slot < entry->count; slot++) {
+                uint16_t page = entry->pages[slot];
+                if (page >= PAK_TOTAL_PAGES) {
+                    continue;
+                }
+#if !CONTROLLER_PAK_XIP_READS
+                memcpy(&controller_pak_data[page * CONTROLLER_PAK_PAGE_SIZE], entry->data[slot],
+                       CONTROLLER_PAK_PAGE_SIZE);
+#endif
+                pak_set_location(page, PAK_LOCATION(block, slot));
+            }
+        }
+    
+        if (block == newest) {
             break;
         }
     }
+    log_sequence = pak_log_block(newest)->sequence + 1;
     
-    if (!flash_empty) {
-        // Copy data from flash to RAM
-        memcpy(controller_pak_data, flash_data, CONTROLLER_PAK_SIZE);
-    } else {
-        // Flash is empty, format the pak
-        controller_pak_format();
+    // Continue after the newest block, skipping anything half-written by a power loss
+    log_head = (newest + 1) % PAK_LOG_BLOCKS;
+    while (log_head % PAK_LOG_BLOCKS_PER_SECTOR != 0 &&
+           !pak_flash_is_erased(FLASH_STORAGE_OFFSET + log_head * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE)) {
+        log_head = (log_head + 1) % PAK_LOG_BLOCKS;
     }
-} 
\ No newline at end of file
+    
+    // Sectors outside the live range must be erased before the log reaches them
+    uint32_t free_sectors = pak_log_free_sectors();
+    uint32_t sector = (log_head + PAK_LOG_BLOCKS_PER_SECTOR - 1) / PAK_LOG_BLOCKS_PER_SECTOR;
+    for (uint32_t i = 0; i < free_sectors; i++, sector++) {
+        sector %= FLASH_STORAGE_SECTORS;
+        if (importing && sector < PAK_LEGACY_SECTORS) {
+            continue;   // Still the image
+        }
+        if (!pak_flash_is_erased(FLASH_STORAGE_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) {
+            pak_flash_erase_sector(sector);
+        }
+    }
+    
+    if (importing) {
+        pak_legacy_finish();
+    }
+}
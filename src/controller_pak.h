@@ -5,12 +5,16 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-// Function prototypes
+// Function prototypes (one pak per controller port)
 bool controller_pak_init(void);
-void controller_pak_read(uint16_t address, uint8_t* data, size_t length);
-void controller_pak_write(uint16_t address, const uint8_t* data, size_t length);
+void controller_pak_read(uint8_t port, uint16_t address, uint8_t* data, size_t length);
+uint8_t controller_pak_read_crc(uint8_t port, uint16_t address);
+bool controller_pak_write(uint8_t port, uint16_t address, const uint8_t* data, size_t length);
 void controller_pak_format(void);
 bool controller_pak_is_present(void);
+bool controller_pak_is_ready(void);
+bool controller_pak_save_pending(void);
+void controller_pak_task(void);
 
 // Internal functions
 void controller_pak_save_to_flash(void);
@@ -2,59 +2,127 @@
 #include "config.h"
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
-#include <stdlib.h>
-#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+#include "encoder.pio.h"
+#include "stick.h"
+
+// The decoder reads each encoder as two consecutive pins (A, then B)
+_Static_assert(ENCODER_X0_PIN == ENCODER_X1_PIN + 1, "X encoder pins must be consecutive");
+_Static_assert(ENCODER_Y0_PIN == ENCODER_Y1_PIN + 1, "Y encoder pins must be consecutive");
 
 // Global encoder state
 static encoder_state_t encoder_state = {0};
 
-// GPIO interrupt handler
-void gpio_callback(uint gpio, uint32_t events) {
-    // Handle X-axis encoder interrupts
-    if (gpio == ENCODER_X1_PIN || gpio == ENCODER_X0_PIN) {
-        encoder_x_interrupt_handler(gpio, events);
+// Edge log
+//
+// The decoder pushes the count on every edge. Per axis, one DMA channel moves
+// it into a ring, then chains to a second channel that stores the timer's low
+// word in a parallel ring and chains back. Each edge so gets a timestamp within
+// a few cycles of the decoder seeing it, with no CPU involvement.
+#define ENCODER_RING_SIZE 16
+#define ENCODER_RING_BYTES (ENCODER_RING_SIZE * sizeof(uint32_t))
+#define ENCODER_RING_BITS 6    // log2(ENCODER_RING_BYTES) for DMA address wrapping
+
+_Static_assert(ENCODER_RING_BYTES == 1u << ENCODER_RING_BITS, "Ring size and wrap bits disagree");
+_Static_assert(ENCODER_VELOCITY_EDGES < ENCODER_RING_SIZE, "Velocity window longer than the edge ring");
+
+enum { AXIS_X, AXIS_Y, AXIS_COUNT };
+
+static uint32_t edge_counts[AXIS_COUNT][ENCODER_RING_SIZE] __attribute__((aligned(ENCODER_RING_BYTES)));
+static uint32_t edge_times[AXIS_COUNT][ENCODER_RING_SIZE] __attribute__((aligned(ENCODER_RING_BYTES)));
+static int time_dma_chan[AXIS_COUNT];
+
+static void encoder_dma_init(uint axis, uint sm) {
+    int count_chan = dma_claim_unused_channel(true);
+    time_dma_chan[axis] = dma_claim_unused_channel(true);
+    
+    // Count: decoder FIFO -> count ring, one word per edge
+    dma_channel_config c = dma_channel_get_default_config(count_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, ENCODER_RING_BITS);
+    channel_config_set_dreq(&c, pio_get_dreq(ENCODER_PIO, sm, false));
+    channel_config_set_chain_to(&c, time_dma_chan[axis]);
+    dma_channel_configure(count_chan, &c, edge_counts[axis], &ENCODER_PIO->rxf[sm], 1, false);
+    
+    // Timestamp: timer -> time ring, straight after each count, then re-arm
+    c = dma_channel_get_default_config(time_dma_chan[axis]);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, ENCODER_RING_BITS);
+    channel_config_set_chain_to(&c, count_chan);
+    dma_channel_configure(time_dma_chan[axis], &c, edge_times[axis], &timer_hw->timerawl, 1, false);
+    
+    dma_channel_start(count_chan);
+}
+
+// Ring slot of the newest edge with both count and timestamp stored
+static inline uint32_t __not_in_flash_func(encoder_latest_edge)(uint axis) {
+    uint32_t next = (dma_channel_hw_addr(time_dma_chan[axis])->write_addr -
+                     (uintptr_t)edge_times[axis]) / sizeof(uint32_t);
+    return (next - 1) % ENCODER_RING_SIZE;
+}
+
+// Latest count from a quadrature decoder state machine
+static int32_t __not_in_flash_func(encoder_read_count)(uint axis) {
+    // The decoder counts down when pin A (X1/Y1) leads, which is our positive direction
+    return -(int32_t)edge_counts[axis][encoder_latest_edge(axis)];
+}
+
+#if ENCODER_EXTRAPOLATION
+// Count at this moment in 1/256ths, extrapolated from the recent edge rate.
+// Between edges the stick keeps moving at the speed it crossed the last few,
+// but never by a whole count (that would have produced another edge), and
+// once the next edge is overdue the estimate falls back to the last count.
+static int32_t __not_in_flash_func(encoder_read_position)(uint axis) {
+    uint32_t latest = encoder_latest_edge(axis);
+    uint32_t oldest = (latest - ENCODER_VELOCITY_EDGES) % ENCODER_RING_SIZE;
+    
+    int32_t count = -(int32_t)edge_counts[axis][latest];
+    int32_t moved = count + (int32_t)edge_counts[axis][oldest];
+    uint32_t span = edge_times[axis][latest] - edge_times[axis][oldest];
+    uint32_t since = time_us_32() - edge_times[axis][latest];
+    uint32_t interval = span / ENCODER_VELOCITY_EDGES;
+    
+    if (moved == 0 || span == 0 || span > ENCODER_VELOCITY_WINDOW_US || since > 2 * interval) {
+        return count * 256;
     }
-    // Handle Y-axis encoder interrupts
-    else if (gpio == ENCODER_Y1_PIN || gpio == ENCODER_Y0_PIN) {
-        encoder_y_interrupt_handler(gpio, events);
+    
+    if (since > interval) {
+        since = interval;
     }
+    int32_t offset = (int32_t)((since << 8) / span) * moved;
+    if (offset > 255) offset = 255;
+    if (offset < -255) offset = -255;
+    
+    return count * 256 + offset;
 }
+#endif
 
 void encoder_init(void) {
-    // Initialize GPIO pins for encoders
-    gpio_init(ENCODER_X1_PIN);
-    gpio_init(ENCODER_X0_PIN);
-    gpio_init(ENCODER_Y1_PIN);
-    gpio_init(ENCODER_Y0_PIN);
-    
-    // Set as inputs with pull-ups
-    gpio_set_dir(ENCODER_X1_PIN, GPIO_IN);
-    gpio_set_dir(ENCODER_X0_PIN, GPIO_IN);
-    gpio_set_dir(ENCODER_Y1_PIN, GPIO_IN);
-    gpio_set_dir(ENCODER_Y0_PIN, GPIO_IN);
-    
-    gpio_pull_up(ENCODER_X1_PIN);
-    gpio_pull_up(ENCODER_X0_PIN);
-    gpio_pull_up(ENCODER_Y1_PIN);
-    gpio_pull_up(ENCODER_Y0_PIN);
-    
-    // Set up interrupts for both edges on encoder A pins
-    gpio_set_irq_enabled_with_callback(ENCODER_X1_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &gpio_callback);
-    gpio_set_irq_enabled(ENCODER_Y1_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+    // Load the decoder (must sit at offset 0) and start one state machine per axis
+    pio_add_program_at_offset(ENCODER_PIO, &quadrature_encoder_program, 0);
+    quadrature_encoder_program_init(ENCODER_PIO, ENCODER_X_PIO_SM, ENCODER_X1_PIN);
+    quadrature_encoder_program_init(ENCODER_PIO, ENCODER_Y_PIO_SM, ENCODER_Y1_PIN);
+    encoder_dma_init(AXIS_X, ENCODER_X_PIO_SM);
+    encoder_dma_init(AXIS_Y, ENCODER_Y_PIO_SM);
     
     // Initialize state
     encoder_state.x_position = 0;
     encoder_state.y_position = 0;
-    encoder_state.x_last_state = 0;
-    encoder_state.y_last_state = 0;
+    encoder_state.x_center = 0;
+    encoder_state.y_center = 0;
     encoder_state.initialized = true;
-    
-    // Read initial states
-    encoder_state.x_last_state = (gpio_get(ENCODER_X1_PIN) << 1) | gpio_get(ENCODER_X0_PIN);
-    encoder_state.y_last_state = (gpio_get(ENCODER_Y1_PIN) << 1) | gpio_get(ENCODER_Y0_PIN);
 }
 
 void encoder_reset(void) {
+    // Make the current decoder counts the new zero
+    encoder_state.x_center = encoder_read_count(AXIS_X);
+    encoder_state.y_center = encoder_read_count(AXIS_Y);
     encoder_state.x_position = 0;
     encoder_state.y_position = 0;
 }
@@ -64,90 +132,29 @@ void encoder_set_center(void) {
     encoder_reset();
 }
 
-int8_t encoder_get_x(void) {
-    if (!encoder_state.initialized) {
-        return 0;
-    }
-    
-    // Scale encoder position to N64 controller range
-    int32_t scaled_x = encoder_state.x_position * ENCODER_SCALE_FACTOR;
-    
-    // Apply deadzone
-    if (abs(scaled_x) < STICK_DEADZONE) {
-        scaled_x = 0;
-    }
-    
-    // Clamp to controller range
-    if (scaled_x > STICK_MAX_VALUE) scaled_x = STICK_MAX_VALUE;
-    if (scaled_x < STICK_MIN_VALUE) scaled_x = STICK_MIN_VALUE;
-    
-    return (int8_t)scaled_x;
-}
-
-int8_t encoder_get_y(void) {
+// Called on both cores (core 1 samples at each POLL), so the position is
+// worked out in locals; only core 0 records it in encoder_state
+void __not_in_flash_func(encoder_get_stick)(int8_t* x, int8_t* y) {
     if (!encoder_state.initialized) {
-        return 0;
+        *x = 0;
+        *y = 0;
+        return;
     }
     
-    // Scale encoder position to N64 controller range
-    int32_t scaled_y = encoder_state.y_position * ENCODER_SCALE_FACTOR;
-    
-    // Apply deadzone
-    if (abs(scaled_y) < STICK_DEADZONE) {
-        scaled_y = 0;
+#if ENCODER_EXTRAPOLATION
+    // Round the extrapolated position to the nearest count
+    int32_t x_position = ((encoder_read_position(AXIS_X) + 128) >> 8) - encoder_state.x_center;
+    int32_t y_position = ((encoder_read_position(AXIS_Y) + 128) >> 8) - encoder_state.y_center;
+#else
+    int32_t x_position = encoder_read_count(AXIS_X) - encoder_state.x_center;
+    int32_t y_position = encoder_read_count(AXIS_Y) - encoder_state.y_center;
+#endif
+    
+    if (get_core_num() == 0) {
+        encoder_state.x_position = x_position;
+        encoder_state.y_position = y_position;
     }
     
-    // Clamp to controller range
-    if (scaled_y > STICK_MAX_VALUE) scaled_y = STICK_MAX_VALUE;
-    if (scaled_y < STICK_MIN_VALUE) scaled_y = STICK_MIN_VALUE;
-    
-    return (int8_t)scaled_y;
+    // Scale, deadzone, curve and gate come from the stick profile tables
+    stick_map(x_position, y_position, x, y);
 }
-
-void encoder_x_interrupt_handler(uint gpio, uint32_t events) {
-    // Read current state of both X encoder pins
-    uint32_t current_state = (gpio_get(ENCODER_X1_PIN) << 1) | gpio_get(ENCODER_X0_PIN);
-    uint32_t last_state = encoder_state.x_last_state;
-    
-    // Quadrature decoding using state transition table
-    // Forward: 00 -> 01 -> 11 -> 10 -> 00
-    // Reverse: 00 -> 10 -> 11 -> 01 -> 00
-    
-    int8_t direction = 0;
-    
-    // State transition lookup table for quadrature decoding
-    // [last_state][current_state] = direction
-    static const int8_t quadrature_table[4][4] = {
-        // 00, 01, 10, 11
-        { 0, -1,  1,  0},  // from 00
-        { 1,  0,  0, -1},  // from 01
-        {-1,  0,  0,  1},  // from 10
-        { 0,  1, -1,  0}   // from 11
-    };
-    
-    direction = quadrature_table[last_state][current_state];
-    encoder_state.x_position += direction;
-    encoder_state.x_last_state = current_state;
-}
-
-void encoder_y_interrupt_handler(uint gpio, uint32_t events) {
-    // Read current state of both Y encoder pins
-    uint32_t current_state = (gpio_get(ENCODER_Y1_PIN) << 1) | gpio_get(ENCODER_Y0_PIN);
-    uint32_t last_state = encoder_state.y_last_state;
-    
-    // Quadrature decoding using state transition table
-    int8_t direction = 0;
-    
-    // State transition lookup table for quadrature decoding
-    static const int8_t quadrature_table[4][4] = {
-        // 00, 01, 10, 11
-        { 0, -1,  1,  0},  // from 00
-        { 1,  0,  0, -1},  // from 01
-        {-1,  0,  0,  1},  // from 10
-        { 0,  1, -1,  0}   // from 11
-    };
-    
-    direction = quadrature_table[last_state][current_state];
-    encoder_state.y_position += direction;
-    encoder_state.y_last_state = current_state;
-} 
\ No newline at end of file
@@ -3,26 +3,20 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "pico/types.h"
 
 // Encoder state structure
 typedef struct {
-    volatile int32_t x_position;
+    volatile int32_t x_position;   // Last position read on core 0, relative to center
     volatile int32_t y_position;
-    volatile uint32_t x_last_state;
-    volatile uint32_t y_last_state;
+    volatile int32_t x_center;     // Decoder count at the stick's center
+    volatile int32_t y_center;
     bool initialized;
 } encoder_state_t;
 
 // Function prototypes
 void encoder_init(void);
 void encoder_reset(void);
-int8_t encoder_get_x(void);
-int8_t encoder_get_y(void);
+void encoder_get_stick(int8_t* x, int8_t* y);
 void encoder_set_center(void);
 
-// Internal interrupt handlers (called from GPIO IRQ)
-void encoder_x_interrupt_handler(uint gpio, uint32_t events);
-void encoder_y_interrupt_handler(uint gpio, uint32_t events);
-
-#endif // ENCODER_H 
\ No newline at end of file
+#endif // ENCODER_H
@@ -0,0 +1,201 @@
+#include "event_log.h"
+#include "config.h"
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/platform.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#if DEBUG_ENABLE
+
+_Static_assert((EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)) == 0, "EVENT_LOG_SIZE must be a power of two");
+_Static_assert(sizeof(event_t) == 16, "Event records should stay 16 bytes");
+
+// Single producer (the owning core), single consumer (core 0 in
+// event_log_task). Indices run freely and wrap at 2^32.
+typedef struct {
+    event_t records[EVENT_LOG_SIZE];
+    uint32_t head;          // Written by the producer
+    uint32_t tail;          // Written by the consumer
+    uint32_t dropped;       // Written by the producer
+} event_ring_t;
+
+static event_ring_t rings[2];
+static uint32_t dropped_reported[2];
+
+// Line being fed to the UART
+static char line[96];
+static uint32_t line_length = 0;
+static uint32_t line_sent = 0;
+
+static const char* const event_names[EVENT_TYPE_COUNT] = {
+    [EVENT_BOOT] = "boot",
+    [EVENT_INIT_FAILED] = "init-failed",
+    [EVENT_COMMAND] = "command",
+    [EVENT_REPLY] = "reply",
+    [EVENT_FRAME_DROPPED] = "frame-dropped",
+    [EVENT_CRC_ERROR] = "crc-error",
+    [EVENT_PAK_SAVE] = "pak-save",
+    [EVENT_PAK_ERASE] = "pak-erase",
+    [EVENT_STATE] = "state",
+    [EVENT_PORT_STATS] = "port-stats",
+    [EVENT_FIRST_REPLY] = "first-reply",
+    [EVENT_SLEEP] = "sleep",
+    [EVENT_WAKE] = "wake",
+    [EVENT_RESYNC] = "resync",
+};
+
+static const char* const boot_stage_names[] = {
+    [EVENT_BOOT_START] = "start",
+    [EVENT_BOOT_ENCODERS] = "encoders",
+    [EVENT_BOOT_BUTTONS] = "buttons",
+    [EVENT_BOOT_PAK] = "pak",
+    [EVENT_BOOT_PROTOCOL] = "protocol",
+    [EVENT_BOOT_COMPLETE] = "complete",
+};
+
+void event_log_init(void) {
+    // Own UART and pin: the default stdio pins are the Joybus data lines
+    uart_init(DEBUG_UART, DEBUG_UART_BAUD);
+    gpio_set_function(DEBUG_UART_TX_PIN, GPIO_FUNC_UART);
+}
+
+// A few loads and stores, no locks: safe to call on the reply path
+void __not_in_flash_func(event_log_write)(event_type_t type, uint8_t port, uint16_t arg, uint32_t a, uint32_t b) {
+    event_ring_t* ring = &rings[get_core_num()];
+    uint32_t head = ring->head;
+    
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= EVENT_LOG_SIZE) {
+        ring->dropped++;
+        return;
+    }
+    
+    event_t* event = &ring->records[head & (EVENT_LOG_SIZE - 1)];
+    event->time_us = time_us_32();
+    event->type = type;
+    event->port = port;
+    event->arg = arg;
+    event->a = a;
+    event->b = b;
+    
+    // Publish the record
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static const char* boot_stage_name(uint16_t stage) {
+    if (stage < sizeof(boot_stage_names) / sizeof(boot_stage_names[0])) {
+        return boot_stage_names[stage];
+    }
+    return "?";
+}
+
+// One line per record: time, core, event, then its fields
+static int event_format(const event_t* event, uint8_t core) {
+    int prefix = snprintf(line, sizeof(line), "%10lu %u %s", (unsigned long)event->time_us, core,
+                          event->type < EVENT_TYPE_COUNT ? event_names[event->type] : "?");
+    char* out = line + prefix;
+    size_t room = sizeof(line) - prefix;
+    unsigned long a = event->a;
+    unsigned long b = event->b;
+    
+    switch (event->type) {
+        case EVENT_BOOT:
+        case EVENT_INIT_FAILED:
+            return prefix + snprintf(out, room, " %s\r\n", boot_stage_name(event->arg));
+        case EVENT_COMMAND:
+            return prefix + snprintf(out, room, " port=%u cmd=0x%02X len=%lu start=%lu\r\n",
+                                     event->port + 1, event->arg, a, b);
+        case EVENT_REPLY:
+            return prefix + snprintf(out, room, " port=%u cmd=0x%02X start=%lu end=%lu\r\n",
+                                     event->port + 1, event->arg, a, b);
+        case EVENT_FRAME_DROPPED:
+            if (b) {
+                return prefix + snprintf(out, room, " port=%u cmd=0x%02X len=%lu late_us=%lu\r\n",
+                                         event->port + 1, event->arg, a, b);
+            }
+            return prefix + snprintf(out, room, " port=%u cmd=0x%02X len=%lu\r\n", event->port + 1, event->arg, a);
+        case EVENT_CRC_ERROR:
+            return prefix + snprintf(out, room, " port=%u addr=0x%04X\r\n", event->port + 1, event->arg);
+        case EVENT_PAK_SAVE:
+            return prefix + snprintf(out, room, " block=%lu pages=%lu\r\n", a, b);
+        case EVENT_PAK_ERASE:
+            return prefix + snprintf(out, room, " sector=%lu\r\n", a);
+        case EVENT_STATE:
+            return prefix + snprintf(out, room, " buttons=0x%04X x=%ld y=%ld\r\n", event->arg,
+                                     (long)(int32_t)event->a, (long)(int32_t)event->b);
+        case EVENT_PORT_STATS:
+            return prefix + snprintf(out, room, " port=%u received=%lu dropped=%lu\r\n", event->port + 1, a, b);
+        case EVENT_FIRST_REPLY:
+            return prefix + snprintf(out, room, " us=%lu\r\n", a);
+        case EVENT_SLEEP:
+            return prefix + snprintf(out, room, " count=%lu\r\n", a);
+        case EVENT_WAKE:
+            return prefix + snprintf(out, room, " latency_us=%lu\r\n", a);
+        case EVENT_RESYNC:
+            return prefix + snprintf(out, room, " port=%u\r\n", event->port + 1);
+        default:
+            return prefix + snprintf(out, room, " port=%u arg=%u a=%lu b=%lu\r\n", event->port + 1, event->arg, a, b);
+    }
+}
+
+// Format the oldest pending record of either core into the line buffer
+static bool event_log_next_line(void) {
+    // Report overflow before the records that made it
+    for (uint8_t core = 0; core < 2; core++) {
+        uint32_t dropped = __atomic_load_n(&rings[core].dropped, __ATOMIC_RELAXED);
+        if (dropped != dropped_reported[core]) {
+            line_length = snprintf(line, sizeof(line), "%10lu %u events-dropped count=%lu\r\n",
+                                   (unsigned long)time_us_32(), core,
+                                   (unsigned long)(dropped - dropped_reported[core]));
+            dropped_reported[core] = dropped;
+            line_sent = 0;
+            return true;
+        }
+    }
+    
+    // Oldest first across the two rings
+    event_ring_t* oldest = NULL;
+    uint8_t oldest_core = 0;
+    for (uint8_t core = 0; core < 2; core++) {
+        event_ring_t* ring = &rings[core];
+        uint32_t tail = ring->tail;
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+            continue;
+        }
+        if (!oldest || (int32_t)(ring->records[tail & (EVENT_LOG_SIZE - 1)].time_us -
+                                 oldest->records[oldest->tail & (EVENT_LOG_SIZE - 1)].time_us) < 0) {
+            oldest = ring;
+            oldest_core = core;
+        }
+    }
+    if (!oldest) {
+        return false;
+    }
+    
+    event_t event = oldest->records[oldest->tail & (EVENT_LOG_SIZE - 1)];
+    __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+    
+    int length = event_format(&event, oldest_core);
+    line_length = (length < (int)sizeof(line)) ? (uint32_t)length : sizeof(line) - 1;
+    line_sent = 0;
+    return true;
+}
+
+// Called from the core 0 main loop: hands the UART only what its TX FIFO can
+// take right now, so this never waits on the link
+void event_log_task(void) {
+    while (uart_is_writable(DEBUG_UART)) {
+        if (line_sent == line_length && !event_log_next_line()) {
+            return;
+        }
+        uart_putc_raw(DEBUG_UART, line[line_sent++]);
+    }
+}
+
+// Wait for the bytes already in the UART FIFO (before its clock is gated).
+// Records still in the rings stay there.
+void event_log_flush(void) {
+    uart_tx_wait_blocking(DEBUG_UART);
+}
+
+#endif // DEBUG_ENABLE
@@ -0,0 +1,65 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Binary event log: fixed-size records written to a lock-free ring per core,
+// drained on core 0 by event_log_task() and formatted onto the debug UART only
+// while its TX FIFO has room. Writing a record never waits; when a ring is
+// full the record is dropped and counted.
+//
+// Each core writes only its own ring. On core 0 write from thread context
+// only (not from interrupt handlers).
+
+typedef enum {
+    EVENT_BOOT,             // arg: event_boot_stage_t reached
+    EVENT_INIT_FAILED,      // arg: event_boot_stage_t that failed
+    EVENT_COMMAND,          // port, arg: command, a: frame length, b: frame start (us)
+    EVENT_REPLY,            // port, arg: command, a: reply start (us), b: reply end (us)
+    EVENT_FRAME_DROPPED,    // port, arg: command (0xFFFF for an empty frame), a: frame length, b: age (us) if too late
+    EVENT_CRC_ERROR,        // port, arg: pak address
+    EVENT_PAK_SAVE,         // a: first log block, b: pages
+    EVENT_PAK_ERASE,        // a: sector
+    EVENT_STATE,            // arg: buttons, a: stick X, b: stick Y
+    EVENT_PORT_STATS,       // port, a: frames received, b: frames dropped
+    EVENT_FIRST_REPLY,      // a: microseconds after reset
+    EVENT_SLEEP,            // a: sleeps so far
+    EVENT_WAKE,             // a: data line edge to first reply (us)
+    EVENT_RESYNC,           // port: receiver restarted
+    EVENT_TYPE_COUNT
+} event_type_t;
+
+typedef enum {
+    EVENT_BOOT_START,
+    EVENT_BOOT_ENCODERS,
+    EVENT_BOOT_BUTTONS,
+    EVENT_BOOT_PAK,
+    EVENT_BOOT_PROTOCOL,
+    EVENT_BOOT_COMPLETE
+} event_boot_stage_t;
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t type;           // event_type_t
+    uint8_t port;
+    uint16_t arg;
+    uint32_t a;
+    uint32_t b;
+} event_t;
+
+// Function prototypes
+#if DEBUG_ENABLE
+void event_log_init(void);
+void event_log_write(event_type_t type, uint8_t port, uint16_t arg, uint32_t a, uint32_t b);
+void event_log_task(void);
+void event_log_flush(void);
+#else
+static inline void event_log_init(void) {}
+static inline void event_log_write(event_type_t type, uint8_t port, uint16_t arg, uint32_t a, uint32_t b) {}
+static inline void event_log_task(void) {}
+static inline void event_log_flush(void) {}
+#endif
+
+#endif // EVENT_LOG_H
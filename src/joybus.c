@@ -0,0 +1,66 @@
+#include "joybus.h"
+#include "n64_protocol.h"
+#include "buttons.h"
+
+// Expected frame length for a command (command byte included)
+size_t JOYBUS_RAM_FUNC(joybus_command_length)(uint8_t command) {
+    switch (command) {
+        case N64_CMD_READ:
+            return N64_CMD_READ_LENGTH;
+        case N64_CMD_WRITE:
+            return N64_CMD_WRITE_LENGTH;
+        default:
+            return 1;
+    }
+}
+
+// Encode the on-wire POLL reply from a packed state word
+uint32_t JOYBUS_RAM_FUNC(joybus_encode_poll_reply)(uint32_t state_word) {
+    uint32_t buttons = state_word >> 16;
+    
+    // Handle reset condition
+    if ((buttons & (N64_BUTTON_L | N64_BUTTON_R | N64_BUTTON_START)) == 
+        (N64_BUTTON_L | N64_BUTTON_R | N64_BUTTON_START)) {
+        buttons |= 0x8000; // Set reset bit
+        buttons &= ~N64_BUTTON_START; // Clear start bit when reset is active
+    }
+    
+    return (buttons << 16) | (state_word & 0xFFFF);
+}
+
+// Build a TX frame for the n64_tx state machine, returns its length in words
+size_t JOYBUS_RAM_FUNC(joybus_pack_response)(uint32_t* frame, const uint8_t* data, size_t length) {
+    size_t words = JOYBUS_TX_FRAME_WORDS(length);
+    
+    // Bit count first, then the payload MSB first
+    frame[0] = length * 8 - 1;
+    for (size_t i = 1; i < words; i++) {
+        frame[i] = 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        frame[1 + i / 4] |= (uint32_t)data[i] << (24 - 8 * (i % 4));
+    }
+    
+    return words;
+}
+
+// Checksum lookup tables, generated at build time by tools/gen_joybus_tables.py
+// from the CRC polynomial and the per-bit address checksum constants. The
+// address checksum is an XOR of one constant per set address bit, so it splits
+// into a lookup for bits 15-10 and one for bits 9-5.
+#define JOYBUS_TABLE_SECTION JOYBUS_RAM_DATA("joybus")
+#include "joybus_tables.h"
+
+// CRC calculation for controller pak operations
+uint8_t JOYBUS_RAM_FUNC(calculate_crc)(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc = crc_table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+// Address checksum calculation for controller pak
+uint8_t JOYBUS_RAM_FUNC(calculate_address_checksum)(uint16_t address) {
+    return address_checksum_high[address >> 10] ^ address_checksum_low[(address >> 5) & 0x1F];
+}
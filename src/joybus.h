@@ -0,0 +1,33 @@
+#ifndef JOYBUS_H
+#define JOYBUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hardware-independent Joybus helpers: framing, reply encoding and pak
+// checksums. Nothing in here touches the SDK, so it also builds on a host.
+
+// Everything here is on the reply path, so on the RP2040 it runs from SRAM
+// (the same sections as the SDK's __not_in_flash_func); on a host the markers
+// compile away
+#if PICO_ON_DEVICE
+#define JOYBUS_RAM_FUNC(name) __attribute__((section(".time_critical." #name))) name
+#define JOYBUS_RAM_DATA(group) __attribute__((section(".time_critical." group)))
+#else
+#define JOYBUS_RAM_FUNC(name) name
+#define JOYBUS_RAM_DATA(group)
+#endif
+
+// Words in a TX frame: bit count followed by the payload packed 32 bits per word
+#define JOYBUS_TX_FRAME_WORDS(length) (1 + ((length) + 3) / 4)
+
+// Function prototypes
+size_t joybus_command_length(uint8_t command);
+uint32_t joybus_encode_poll_reply(uint32_t state_word);
+size_t joybus_pack_response(uint32_t* frame, const uint8_t* data, size_t length);
+
+// Controller pak checksums
+uint8_t calculate_crc(const uint8_t* data, size_t length);
+uint8_t calculate_address_checksum(uint16_t address);
+
+#endif // JOYBUS_H
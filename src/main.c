@@ -1,145 +1,178 @@
-#include <stdio.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
 
 #include "config.h"
 #include "n64_protocol.h"
 #include "encoder.h"
 #include "buttons.h"
 #include "controller_pak.h"
+#include "status_led.h"
+#include "power.h"
+#include "event_log.h"
+#include "stats_console.h"
 
 // Global controller state
 static n64_controller_state_t controller_state = {0};
 
-// Status LED control
-void status_led_init(void) {
-    gpio_init(STATUS_LED_PIN);
-    gpio_set_dir(STATUS_LED_PIN, GPIO_OUT);
-    gpio_put(STATUS_LED_PIN, 0);
-}
-
-void status_led_set(bool on) {
-    gpio_put(STATUS_LED_PIN, on);
-}
-
-// Status LED blink pattern for debugging
-void status_led_blink(int count, int delay_ms) {
-    for (int i = 0; i < count; i++) {
-        status_led_set(true);
-        sleep_ms(delay_ms);
-        status_led_set(false);
-        if (i < count - 1) {
-            sleep_ms(delay_ms);
-        }
-    }
-}
-
 // Core 1 task - handles N64 protocol communication
 void core1_task(void) {
+    // Let core 0 park this core while it writes the pak to flash
+    multicore_lockout_victim_init();
+    n64_protocol_core_init();
+    
     while (true) {
-        // Handle N64 protocol communication
+        // Handle N64 protocol communication (sleeps until a frame arrives)
         n64_protocol_task();
-        
-        // Small delay to prevent busy waiting
-        sleep_us(10);
     }
 }
 
+// Runs on core 1 as a POLL arrives: start from the state core 0 published
+// (debounced buttons) and refresh what can be read in well under a microsecond.
+// New presses show up at once, releases still wait for the debounce.
+static uint32_t __not_in_flash_func(sample_controller_state)(uint8_t port) {
+    n64_controller_state_t state;
+    n64_protocol_get_state(port, &state);
+    
+    state.buttons |= buttons_read_raw();
+    encoder_get_stick(&state.stick_x, &state.stick_y);
+    
+    return n64_state_pack(&state);
+}
+
 // Update controller state from inputs
 void update_controller_state(void) {
     // Read button states
     controller_state.buttons = buttons_read();
     
     // Read encoder positions
-    controller_state.stick_x = encoder_get_x();
-    controller_state.stick_y = encoder_get_y();
+    encoder_get_stick(&controller_state.stick_x, &controller_state.stick_y);
     
     // Handle reset condition (L + R + Start pressed)
+    static bool reset_held = false;
     if (buttons_is_reset_pressed()) {
         encoder_set_center(); // Reset stick to center
-        status_led_blink(3, 100); // Indicate reset
+        if (!reset_held) {
+            status_led_play(&STATUS_LED_RESET); // Indicate reset
+        }
+        reset_held = true;
+    } else {
+        reset_held = false;
+    }
+    
+    // Update the protocol handler with new state; every port mirrors the
+    // local inputs
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        n64_protocol_update_state(port, &controller_state);
+    }
+}
+
+_Static_assert(SYS_CLOCK_KHZ == 125000 || SYS_CLOCK_KHZ == 133000 ||
+               SYS_CLOCK_KHZ == 200000 || SYS_CLOCK_KHZ == 250000,
+               "Unsupported SYS_CLOCK_KHZ profile");
+
+// Bring clk_sys to the configured profile
+static bool clock_init(void) {
+    if (SYS_CLOCK_KHZ > 200000) {
+        vreg_set_voltage(VREG_VOLTAGE_1_20);
+    } else if (SYS_CLOCK_KHZ > 133000) {
+        vreg_set_voltage(VREG_VOLTAGE_1_15);
+    }
+    if (SYS_CLOCK_KHZ > 133000) {
+        sleep_ms(10);  // Let the regulator settle before the faster clock
+    }
+    
+    return set_sys_clock_khz(SYS_CLOCK_KHZ, false);
+}
+
+// Start answering the console before anything else. Until the rest of the
+// system is up, core 1 replies to INFO with no pak and to POLL with a neutral
+// state, so a console probing right after power-on still finds a controller.
+static bool protocol_start(void) {
+    // Switch clocks first so the PIO dividers see the final clk_sys
+    if (!clock_init()) {
+        return false;
+    }
+    
+    if (!n64_protocol_init()) {
+        return false;
     }
     
-    // Update the protocol handler with new state
-    n64_protocol_update_state(&controller_state);
+    // Launch N64 protocol handler on core 1
+    multicore_launch_core1(core1_task);
+    return true;
 }
 
-// Initialize all subsystems
+// Initialize everything else while core 1 is already answering
 bool system_init(void) {
-    // Initialize stdio
-    stdio_init_all();
+    // Debug output goes through the event log, drained from the main loop
+    event_log_init();
+    event_log_write(EVENT_BOOT, 0, EVENT_BOOT_START, 0, 0);
     
-    #if DEBUG_ENABLE
-    printf("RP2040 N64 Controller Emulator Starting...\n");
-    #endif
+    // Joybus statistics over USB serial, on request
+    stats_console_init();
     
     // Initialize status LED
     status_led_init();
-    status_led_blink(1, 200); // Power-on indicator
+    status_led_play(&STATUS_LED_BOOT); // Power-on indicator
     
     // Initialize encoder system
     encoder_init();
-    #if DEBUG_ENABLE
-    printf("Encoder system initialized\n");
-    #endif
+    encoder_set_center();
+    event_log_write(EVENT_BOOT, 0, EVENT_BOOT_ENCODERS, 0, 0);
     
     // Initialize button system
     buttons_init();
-    #if DEBUG_ENABLE
-    printf("Button system initialized\n");
-    #endif
+    event_log_write(EVENT_BOOT, 0, EVENT_BOOT_BUTTONS, 0, 0);
     
-    // Initialize controller pak emulation
-    if (!controller_pak_init()) {
-        #if DEBUG_ENABLE
-        printf("Controller pak initialization failed\n");
-        #endif
-        status_led_blink(5, 100); // Error indicator
-        return false;
-    }
-    #if DEBUG_ENABLE
-    printf("Controller pak initialized\n");
+    // Live inputs from here on, even while the pak is still loading
+    update_controller_state();
+    #if N64_JIT_POLL_SAMPLING
+    // Build POLL replies from inputs sampled as the command arrives
+    n64_protocol_set_poll_sampler(sample_controller_state);
     #endif
     
-    // Initialize N64 protocol handler
-    if (!n64_protocol_init()) {
-        #if DEBUG_ENABLE
-        printf("N64 protocol initialization failed\n");
-        #endif
-        status_led_blink(10, 100); // Error indicator
+    // Initialize controller pak emulation; INFO reports the pak once this is done
+    if (!controller_pak_init()) {
+        event_log_write(EVENT_INIT_FAILED, 0, EVENT_BOOT_PAK, 0, 0);
+        status_led_play(&STATUS_LED_ERROR_PAK); // Error indicator
         return false;
     }
-    #if DEBUG_ENABLE
-    printf("N64 protocol initialized\n");
-    #endif
+    event_log_write(EVENT_BOOT, 0, EVENT_BOOT_PAK, 0, 0);
+    event_log_write(EVENT_BOOT, 0, EVENT_BOOT_COMPLETE, 0, 0);
     
-    // Center the stick
-    encoder_set_center();
-    
-    #if DEBUG_ENABLE
-    printf("System initialization complete\n");
-    printf("Waiting for N64 console commands...\n");
-    #endif
-    
-    status_led_blink(2, 100); // Success indicator
+    status_led_play(&STATUS_LED_READY); // Success indicator
     return true;
 }
 
 // Main program
 int main(void) {
-    // Initialize system
-    if (!system_init()) {
-        // Initialization failed - flash LED continuously
+    // Joybus responder first, then the rest of the system
+    bool protocol_ok = protocol_start();
+    bool system_ok = system_init();
+    
+    if (!protocol_ok) {
+        event_log_write(EVENT_INIT_FAILED, 0, EVENT_BOOT_PROTOCOL, 0, 0);
+        status_led_play(&STATUS_LED_ERROR_PROTOCOL); // Error indicator
+    }
+    
+    if (!protocol_ok || !system_ok) {
+        // Initialization failed - flash LED continuously after the error code
+        status_led_set_background(&STATUS_LED_FAILED);
         while (true) {
-            status_led_blink(1, 250);
-            sleep_ms(750);
+            event_log_task();
+            __wfi();
         }
     }
     
-    // Launch N64 protocol handler on core 1
-    multicore_launch_core1(core1_task);
+    // Heartbeat LED (slow blink during normal operation), runs off a timer
+    status_led_set_background(&STATUS_LED_HEARTBEAT);
+    
+    power_init();
     
     // Main loop on core 0 - handle input processing
     uint32_t last_update = 0;
@@ -152,27 +185,46 @@ int main(void) {
         if (current_time - last_update >= update_interval_us) {
             update_controller_state();
             last_update = current_time;
-            
-            // Heartbeat LED (slow blink during normal operation)
-            static uint32_t led_timer = 0;
-            if (current_time - led_timer > 1000000) { // 1 second
-                status_led_set(true);
-                sleep_us(50000); // 50ms pulse
-                status_led_set(false);
-                led_timer = current_time;
-            }
         }
         
+        // Restart any Joybus receiver a noise burst has wedged
+        n64_protocol_watchdog();
+        
+        // Save controller pak writes between console polls
+        controller_pak_task();
+        
+        // Answer statistics requests
+        stats_console_task();
+        
+        #if POWER_SLEEP_ENABLE
+        // Console off or unplugged: sleep until the data line moves
+        power_task();
+        #endif
+        
         #if DEBUG_ENABLE
-        // Debug output every second
+        // State snapshot every second
         static uint32_t debug_timer = 0;
         if (current_time - debug_timer > 1000000) {
-            printf("Stick: X=%d, Y=%d, Buttons=0x%04X\n", 
-                   controller_state.stick_x, 
-                   controller_state.stick_y, 
-                   controller_state.buttons);
+            event_log_write(EVENT_STATE, 0, controller_state.buttons,
+                            controller_state.stick_x, controller_state.stick_y);
+            
+            static bool boot_reported = false;
+            uint32_t first_reply_us = n64_protocol_first_reply_us();
+            if (!boot_reported && first_reply_us != 0) {
+                event_log_write(EVENT_FIRST_REPLY, 0, 0, first_reply_us, 0);
+                boot_reported = true;
+            }
+            
+            for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+                n64_protocol_stats_t stats;
+                n64_protocol_get_stats(port, &stats);
+                event_log_write(EVENT_PORT_STATS, port, 0, stats.frames_received, stats.frames_dropped);
+            }
             debug_timer = current_time;
         }
+        
+        // Format and send what the UART can take right now, never waiting
+        event_log_task();
         #endif
         
         // Small delay to prevent busy waiting
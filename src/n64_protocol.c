@@ -1,270 +1,746 @@
 #include "n64_protocol.h"
+#include "joybus.h"
 #include "config.h"
 #include "controller_pak.h"
-#include "buttons.h"
+#include "event_log.h"
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
+#include "hardware/irq.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/systick.h"
 #include "n64_protocol.pio.h"
 #include <string.h>
 
-// Global protocol state
-static n64_controller_state_t current_state = {0};
-static n64_controller_info_t controller_info = {
-    .id_high = N64_CONTROLLER_ID_HIGH,
-    .id_low = N64_CONTROLLER_ID_LOW,
-    .status = 0
+// The PIO program hard-codes the Joybus bit shape in microseconds; keep it in
+// step with config.h
+_Static_assert(n64_port_LOW_US == N64_LOGIC_1_LOW_US, "TX low phase must match a 1 bit");
+_Static_assert(n64_port_LOW_US + n64_port_DATA_US == N64_LOGIC_0_LOW_US, "TX data phase must end a 0 bit's low time");
+_Static_assert(n64_port_LOW_US + n64_port_DATA_US + n64_port_HIGH_US == N64_BIT_PERIOD_US, "TX bit must last one bit period");
+_Static_assert(n64_port_STOP_LOW_US == N64_STOP_CONTROLLER_LOW_US && n64_port_STOP_HIGH_US == N64_STOP_CONTROLLER_HIGH_US,
+               "TX stop bit must match the controller stop bit");
+_Static_assert(n64_port_SAMPLE_US > N64_LOGIC_1_LOW_US && n64_port_SAMPLE_US < N64_LOGIC_0_LOW_US,
+               "RX must sample between the 1 and 0 low times");
+_Static_assert(n64_port_IDLE_US >= N64_BIT_PERIOD_US, "RX idle timeout must outlast any data bit");
+
+// Delays are whole state machine cycles, which is exact only if the divider
+// (clk_sys / cycles per us in MHz) fits the 8.8 fixed point clkdiv register
+_Static_assert((SYS_CLOCK_KHZ * 256LL) % (n64_port_CYCLES_PER_US * 1000LL) == 0,
+               "SYS_CLOCK_KHZ gives an inexact PIO clock divider");
+
+// One state machine per port, each raising its own relative FRAME_IRQ flag
+_Static_assert(N64_PORT_COUNT >= 1 && N64_PORT_COUNT <= 4, "N64_PORT_COUNT must be 1 to 4");
+_Static_assert(n64_port_FRAME_IRQ == 0, "Port n must raise PIO IRQ flag n");
+#define N64_PORT_IRQ_MASK ((1u << N64_PORT_COUNT) - 1)
+
+#define POLL_REPLY_WORDS JOYBUS_TX_FRAME_WORDS(N64_POLL_RESPONSE_LENGTH)
+
+// State machine cycles from the bit count landing in the TX FIFO to the first
+// falling edge of the reply (pull, out, jmp, set, set, pull, set pins 0)
+#define N64_REPLY_SETUP_NS (6 * 1000 / n64_port_CYCLES_PER_US)
+
+// SysTick counts core 1 clk_sys cycles down from 2^24 - 1
+#define N64_SYSTICK_MASK 0x00FFFFFFu
+
+// Per-port protocol state
+typedef struct {
+    uint8_t index;
+    uint pin;
+    n64_controller_info_t info;
+    
+    // Receive path: the state machine pushes one byte per FIFO entry and DMA
+    // collects them here, so a whole frame is available once FRAME_IRQ is raised
+    uint8_t rx_frame[N64_MAX_FRAME_LENGTH];
+    int rx_dma_chan;
+    
+    // Transmit path: bit count followed by the response packed 32 bits per
+    // word, handed to the state machine in a single DMA transfer
+    uint32_t tx_frame[JOYBUS_TX_FRAME_WORDS(N64_MAX_RESPONSE_LENGTH)];
+    int tx_dma_chan;
+    
+    // SysTick value and frame bit count when the last reply was handed over
+    uint32_t reply_cycles;
+    uint32_t reply_bits;
+    
+    // POLL replies are encoded on core 0 ahead of time into a ping-pong pair
+    // of ready-to-send TX frames; core 1 only picks the published one and
+    // starts DMA.
+    //
+    // Core 0 is the only writer and every shared value is a single aligned
+    // word written with one store, so a reader (core 1 or the DMA) always sees
+    // a complete snapshot, even if core 0 laps it. Neither side ever waits.
+    uint32_t poll_reply[2][POLL_REPLY_WORDS];
+    uint32_t poll_reply_index;
+    
+    // Last published state before the reset-bit logic, for n64_protocol_get_state()
+    uint32_t state_word;
+    
+    // Reply built on core 1 from the poll sampler
+    uint32_t poll_sample_reply[POLL_REPLY_WORDS];
+    
+    // Counters and last transaction, written by core 1 only
+    n64_protocol_stats_t stats;
+    
+    // Set by core 0 when the receiver is wedged, cleared by core 1 once it
+    // has restarted the state machine
+    bool resync_requested;
+    
+    // A frame flagged while core 1 was parked for flash work: core 0 records
+    // when the park began and bumps the count, core 1 keeps the last count it
+    // has dealt with
+    uint32_t parked_frame_us;
+    uint32_t parked_frames;
+    uint32_t parked_frames_seen;
+} n64_port_t;
+
+static n64_port_t ports[N64_PORT_COUNT];
+
+static const uint port_pins[4] = {
+    N64_DATA_PIN, N64_PORT2_DATA_PIN, N64_PORT3_DATA_PIN, N64_PORT4_DATA_PIN
 };
 
-static uint n64_tx_offset;
-static uint n64_rx_offset;
-static volatile bool command_received = false;
-static volatile uint8_t last_command = 0;
-
-// CRC calculation for controller pak operations
-uint8_t calculate_crc(const uint8_t* data, size_t length) {
-    uint8_t crc = 0;
-    for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 0x80) {
-                crc = (crc << 1) ^ 0x85;  // N64 CRC polynomial
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    return crc;
+static uint n64_port_offset;
+
+// Just-in-time sampling: when set, POLL replies are built on core 1 from a
+// sample taken as the command arrives instead of core 0's last update
+static n64_poll_sampler_t poll_sampler = NULL;
+
+// Time since reset when the first and the latest reply went out, 0 until then
+static uint32_t first_reply_us = 0;
+static uint32_t last_reply_us = 0;
+
+// Console traffic timing, recorded by core 1 and read by core 0 to fit flash
+// work into the gaps between polls. The console polls the ports back to back,
+// so the quiet gap starts after the last port of a burst and ends when the
+// first one is polled again.
+static uint32_t last_frame_us = 0;
+static uint32_t last_poll_us[N64_PORT_COUNT];
+static uint32_t poll_interval_us = 0;   // Learned poll period, 0 until known
+
+// Reply latency per command class, written by core 1 only. A reset asked for
+// by core 0 is carried out by core 1 between frames.
+static n64_latency_stats_t latency_stats[N64_COMMAND_CLASS_COUNT];
+static bool stats_reset_requested = false;
+
+// Core 0 only: when it parked core 1 and the ports already flagged then
+static uint32_t park_start_us = 0;
+static uint32_t park_flagged = 0;
+
+// Point the RX DMA channel at the start of the frame buffer
+static void __not_in_flash_func(n64_rx_arm)(n64_port_t* port) {
+    dma_channel_abort(port->rx_dma_chan);
+    pio_sm_clear_fifos(N64_PIO, port->index);
+    dma_channel_transfer_to_buffer_now(port->rx_dma_chan, port->rx_frame, N64_MAX_FRAME_LENGTH);
 }
 
-// Address checksum calculation for controller pak
-uint8_t calculate_address_checksum(uint16_t address) {
-    static const uint8_t checksum_table[] = {
-        0x01, 0x1A, 0x0D, 0x1C, 0x0E, 0x07, 0x19, 0x16, 0x0B, 0x1F, 0x15
-    };
+// Let the state machine listen again when a frame gets no reply
+static void __not_in_flash_func(n64_rx_release)(n64_port_t* port) {
+    pio_sm_put(N64_PIO, port->index, 0);
+}
+
+// Put a port's state machine back at the start of the receive loop with the
+// line released, as if it had just been started. It waits for an idle line
+// before taking the next frame.
+static void __not_in_flash_func(n64_port_resync)(n64_port_t* port) {
+    uint sm = port->index;
     
-    uint8_t checksum = 0;
-    for (int i = 10; i >= 0; i--) {
-        if (address & (1 << (15 - i))) {
-            checksum ^= checksum_table[i];
-        }
-    }
-    return checksum;
+    pio_sm_set_enabled(N64_PIO, sm, false);
+    dma_channel_abort(port->tx_dma_chan);
+    pio_sm_restart(N64_PIO, sm);    // Shift registers, counters and stalls
+    pio_sm_exec(N64_PIO, sm, pio_encode_set(pio_pindirs, 0));
+    pio_sm_exec(N64_PIO, sm, pio_encode_jmp(n64_port_offset + n64_port_offset_rx_entry));
+    
+    N64_PIO->fdebug = 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+    pio_interrupt_clear(N64_PIO, n64_port_FRAME_IRQ + sm);
+    n64_rx_arm(port);
+    pio_sm_set_enabled(N64_PIO, sm, true);
 }
 
-bool n64_protocol_init(void) {
-    // Initialize GPIO pin
-    gpio_init(N64_DATA_PIN);
-    gpio_set_dir(N64_DATA_PIN, GPIO_OUT);
-    gpio_put(N64_DATA_PIN, 1); // Idle high
+static void n64_port_init(n64_port_t* port, uint8_t index) {
+    port->index = index;
+    port->pin = port_pins[index];
+    port->info.id_high = N64_CONTROLLER_ID_HIGH;
+    port->info.id_low = N64_CONTROLLER_ID_LOW;
+    port->info.status = 0;
+    port->poll_reply[0][0] = N64_POLL_RESPONSE_LENGTH * 8 - 1;
+    port->poll_reply[1][0] = N64_POLL_RESPONSE_LENGTH * 8 - 1;
+    port->poll_sample_reply[0] = N64_POLL_RESPONSE_LENGTH * 8 - 1;
     
-    // Load PIO programs
-    n64_tx_offset = pio_add_program(N64_PIO, &n64_tx_program);
-    n64_rx_offset = pio_add_program(N64_PIO, &n64_rx_program);
+    // Initialize GPIO pin (line is pulled up and released while idle)
+    gpio_init(port->pin);
+    gpio_set_dir(port->pin, GPIO_IN);
+    gpio_pull_up(port->pin);
     
-    // Initialize PIO state machines
-    n64_tx_program_init(N64_PIO, N64_PIO_SM, n64_tx_offset, N64_DATA_PIN);
+    n64_port_program_init(N64_PIO, index, n64_port_offset, port->pin);
     
-    // Enable the state machine
-    pio_sm_set_enabled(N64_PIO, N64_PIO_SM, true);
+    // DMA drains the RX FIFO into rx_frame, one byte per FIFO entry
+    port->rx_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(port->rx_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(N64_PIO, index, false));
+    dma_channel_configure(port->rx_dma_chan, &c, port->rx_frame, &N64_PIO->rxf[index],
+                          N64_MAX_FRAME_LENGTH, true);
     
-    return true;
+    // DMA feeds whole response frames to the TX FIFO
+    port->tx_dma_chan = dma_claim_unused_channel(true);
+    c = dma_channel_get_default_config(port->tx_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(N64_PIO, index, true));
+    dma_channel_configure(port->tx_dma_chan, &c, &N64_PIO->txf[index], port->tx_frame, 0, false);
+    
+    pio_interrupt_clear(N64_PIO, n64_port_FRAME_IRQ + index);
+    
+    // Route FRAME_IRQ to the NVIC. The interrupt itself stays disabled: core 1
+    // only uses its pending transition as a wake-up event (see n64_protocol_task)
+    pio_set_irq0_source_enabled(N64_PIO, (enum pio_interrupt_source)(pis_interrupt0 + n64_port_FRAME_IRQ + index), true);
 }
 
-void n64_protocol_update_state(const n64_controller_state_t* state) {
-    if (state) {
-        current_state = *state;
+bool n64_protocol_init(void) {
+    // One copy of the program serves every port
+    n64_port_offset = pio_add_program(N64_PIO, &n64_port_program);
+    
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        n64_port_init(&ports[i], i);
     }
+    irq_clear(N64_PIO_IRQ);
+    
+    // Start all ports together
+    pio_set_sm_mask_enabled(N64_PIO, (1u << N64_PORT_COUNT) - 1, true);
+    
+    return true;
 }
 
-void n64_protocol_reset(void) {
-    // Clear any error flags
-    controller_info.status &= ~N64_STATUS_CRC_ERROR;
+// Called from core 0: fill the idle buffer, then publish it
+void n64_protocol_update_state(uint8_t index, const n64_controller_state_t* state) {
+    if (!state || index >= N64_PORT_COUNT) {
+        return;
+    }
     
-    // Reset controller state if needed
-    // The encoder module handles stick centering
+    n64_port_t* port = &ports[index];
+    uint32_t word = n64_state_pack(state);
+    uint32_t next = __atomic_load_n(&port->poll_reply_index, __ATOMIC_RELAXED) ^ 1;
+    
+    __atomic_store_n(&port->poll_reply[next][1], joybus_encode_poll_reply(word), __ATOMIC_RELAXED);
+    __atomic_store_n(&port->state_word, word, __ATOMIC_RELAXED);
+    
+    // Buffer contents must be visible before core 1 can pick it
+    __atomic_store_n(&port->poll_reply_index, next, __ATOMIC_RELEASE);
 }
 
-void n64_send_byte(uint8_t data) {
-    // Send 8 bits using PIO
-    for (int i = 7; i >= 0; i--) {
-        uint32_t bit = (data >> i) & 1;
-        pio_sm_put_blocking(N64_PIO, N64_PIO_SM, bit);
-    }
+void __not_in_flash_func(n64_protocol_get_state)(uint8_t index, n64_controller_state_t* state) {
+    n64_state_unpack(__atomic_load_n(&ports[index].state_word, __ATOMIC_ACQUIRE), state);
+}
+
+// May be set while core 1 is running, once the inputs it reads are set up
+// (NULL sends core 0's pre-encoded replies)
+void n64_protocol_set_poll_sampler(n64_poll_sampler_t sampler) {
+    __atomic_store_n(&poll_sampler, sampler, __ATOMIC_RELEASE);
+}
+
+// Boot latency: microseconds from reset to the first reply, 0 if none yet
+uint32_t n64_protocol_first_reply_us(void) {
+    return __atomic_load_n(&first_reply_us, __ATOMIC_RELAXED);
 }
 
-void n64_send_stop_bit(void) {
-    // Send controller stop bit pattern (2μs low, 1μs high)
-    pio_sm_exec_wait_blocking(N64_PIO, N64_PIO_SM, pio_encode_jmp(n64_tx_offset + n64_tx_offset_send_stop));
+// time_us_32() of the latest reply and the latest frame received
+uint32_t n64_protocol_last_reply_us(void) {
+    return __atomic_load_n(&last_reply_us, __ATOMIC_RELAXED);
 }
 
-uint8_t n64_receive_byte(void) {
-    uint8_t data = 0;
-    // Simple bit-banged receive (could be improved with PIO)
+uint32_t n64_protocol_last_frame_us(void) {
+    return __atomic_load_n(&last_frame_us, __ATOMIC_RELAXED);
+}
+
+uint n64_protocol_port_pin(uint8_t port) {
+    return port_pins[port];
+}
+
+// Called from core 0: true if nothing is expected on the wire for duration_us.
+// After a poll the console finishes its command burst and then stays quiet
+// until the next poll, so the window is the rest of the learned poll period.
+bool n64_protocol_idle_window(uint32_t duration_us) {
+    uint32_t now = time_us_32();
+    uint32_t since_frame = now - __atomic_load_n(&last_frame_us, __ATOMIC_RELAXED);
+    uint32_t interval = __atomic_load_n(&poll_interval_us, __ATOMIC_RELAXED);
+    
+    // Time since the first poll of the latest burst, counting only ports the
+    // console is still polling (UINT32_MAX if there are none)
+    uint32_t since_poll = UINT32_MAX;
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        uint32_t since = now - __atomic_load_n(&last_poll_us[i], __ATOMIC_RELAXED);
+        if (since < N64_CONSOLE_IDLE_US && (since_poll == UINT32_MAX || since > since_poll)) {
+            since_poll = since;
+        }
+    }
+    
+    // Console isn't polling at all
+    if (since_frame >= N64_CONSOLE_IDLE_US) {
+        return true;
+    }
+    
+    // Cadence unknown yet, or the burst after the last poll may not be over
+    if (interval == 0 || since_frame < N64_IDLE_SETTLE_US || since_poll >= interval) {
+        return false;
+    }
     
-    // Wait for start bit (falling edge)
-    while (gpio_get(N64_DATA_PIN));
+    return interval - since_poll >= duration_us + N64_IDLE_GUARD_US;
+}
+
+// Track when frames arrive and learn the poll period from each port's own polls
+static void __not_in_flash_func(n64_record_frame)(n64_port_t* port, uint8_t command) {
+    uint32_t now = time_us_32();
     
-    // Sample 8 bits
-    for (int i = 7; i >= 0; i--) {
-        // Wait for middle of bit period
-        busy_wait_us(2); // Sample at 2μs into bit period
+    if (command == N64_CMD_POLL) {
+        uint32_t interval = now - last_poll_us[port->index];
+        uint32_t estimate = poll_interval_us;
         
-        if (gpio_get(N64_DATA_PIN)) {
-            data |= (1 << i);
+        // A gap of one and a half periods or more means polls never made it
+        // here (a game changing its poll rate shows up the same way)
+        if (estimate != 0 && interval < N64_CONSOLE_IDLE_US && interval >= estimate + estimate / 2) {
+            uint32_t missed = (interval + estimate / 2) / estimate - 1;
+            __atomic_store_n(&port->stats.missed_polls, port->stats.missed_polls + missed, __ATOMIC_RELAXED);
         }
         
-        // Wait for next bit
-        busy_wait_us(2);
+        // Follow shorter periods at once and longer ones slowly, so lag
+        // frames never make the window look bigger than it is
+        if (interval < N64_CONSOLE_IDLE_US) {
+            if (estimate == 0 || interval < estimate) {
+                estimate = interval;
+            } else {
+                estimate += (interval - estimate) / 8;
+            }
+            __atomic_store_n(&poll_interval_us, estimate, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&last_poll_us[port->index], now, __ATOMIC_RELAXED);
     }
+    __atomic_store_n(&last_frame_us, now, __ATOMIC_RELAXED);
+}
+
+void __not_in_flash_func(n64_protocol_reset)(uint8_t index) {
+    // Clear any error flags
+    ports[index].info.status &= ~N64_STATUS_CRC_ERROR;
     
-    return data;
+    // Reset controller state if needed
+    // The encoder module handles stick centering
 }
 
-void n64_handle_info_command(void) {
-    // Send controller ID and status
-    n64_send_byte(controller_info.id_high);
-    n64_send_byte(controller_info.id_low);
-    n64_send_byte(controller_info.status);
-    n64_send_stop_bit();
+// Hand a ready-made TX frame (bit count + packed payload) to the state machine
+static void __not_in_flash_func(n64_send_frame)(n64_port_t* port, const uint32_t* frame, size_t words) {
+    // The state machine appends the stop bit and goes back to listening
+    dma_channel_transfer_from_buffer_now(port->tx_dma_chan, frame, words);
+    port->reply_cycles = systick_hw->cvr;
+    port->reply_bits = frame[0] + 1;
 }
 
-void n64_handle_poll_command(void) {
-    // Send 4 bytes: button state (2 bytes) + stick X + stick Y
-    uint16_t buttons = current_state.buttons;
-    
-    // Handle reset condition
-    if ((buttons & (N64_BUTTON_L | N64_BUTTON_R | N64_BUTTON_START)) == 
-        (N64_BUTTON_L | N64_BUTTON_R | N64_BUTTON_START)) {
-        buttons |= 0x8000; // Set reset bit
-        buttons &= ~N64_BUTTON_START; // Clear start bit when reset is active
+void __not_in_flash_func(n64_send_response)(uint8_t index, const uint8_t* data, size_t length) {
+    n64_port_t* port = &ports[index];
+    n64_send_frame(port, port->tx_frame, joybus_pack_response(port->tx_frame, data, length));
+}
+
+static void __not_in_flash_func(n64_handle_info_command)(n64_port_t* port) {
+    // The pak shows up as inserted once core 0 has finished loading it
+    uint8_t status = port->info.status;
+    if (controller_pak_is_ready() && controller_pak_is_present()) {
+        status |= N64_STATUS_PAK_INSERTED;
     }
     
-    // Send button data (MSB first)
-    n64_send_byte((buttons >> 8) & 0xFF);
-    n64_send_byte(buttons & 0xFF);
-    
-    // Send stick data
-    n64_send_byte((uint8_t)current_state.stick_x);
-    n64_send_byte((uint8_t)current_state.stick_y);
+    // Send controller ID and status
+    uint8_t response[N64_INFO_RESPONSE_LENGTH] = {
+        port->info.id_high,
+        port->info.id_low,
+        status
+    };
+    n64_send_response(port->index, response, sizeof(response));
+}
+
+static void __not_in_flash_func(n64_handle_poll_command)(n64_port_t* port) {
+    // Sample now; the previous reply has been sent, so the buffer is free
+    n64_poll_sampler_t sampler = __atomic_load_n(&poll_sampler, __ATOMIC_ACQUIRE);
+    if (sampler) {
+        port->poll_sample_reply[1] = joybus_encode_poll_reply(sampler(port->index));
+        n64_send_frame(port, port->poll_sample_reply, POLL_REPLY_WORDS);
+        return;
+    }
     
-    n64_send_stop_bit();
+    // Reply was already encoded by core 0, just send the latest buffer
+    uint32_t index = __atomic_load_n(&port->poll_reply_index, __ATOMIC_ACQUIRE);
+    n64_send_frame(port, port->poll_reply[index], POLL_REPLY_WORDS);
 }
 
-void n64_handle_read_command(void) {
-    // Receive 2-byte address with checksum
-    uint16_t address_with_checksum = (n64_receive_byte() << 8) | n64_receive_byte();
+static void __not_in_flash_func(n64_handle_read_command)(n64_port_t* port, const uint8_t* frame) {
+    // 2-byte address with checksum follows the command byte
+    uint16_t address_with_checksum = (frame[1] << 8) | frame[2];
     uint16_t address = address_with_checksum & 0xFFE0; // Mask off checksum bits
     uint8_t received_checksum = address_with_checksum & 0x1F;
     uint8_t calculated_checksum = calculate_address_checksum(address);
     
-    uint8_t response_data[32];
-    uint8_t crc;
+    // 32 bytes of data followed by the CRC
+    uint8_t response[N64_READ_RESPONSE_LENGTH];
     
     if (received_checksum == calculated_checksum) {
-        // Read from controller pak
-        controller_pak_read(address, response_data, 32);
-        crc = calculate_crc(response_data, 32);
+        // Read from this port's controller pak
+        controller_pak_read(port->index, address, response, 32);
+        response[32] = controller_pak_read_crc(port->index, address);
     } else {
         // Invalid checksum - return zeros
-        memset(response_data, 0, 32);
-        crc = 0xFF;
-        controller_info.status |= N64_STATUS_CRC_ERROR;
+        memset(response, 0, 32);
+        response[32] = 0xFF;
+        port->info.status |= N64_STATUS_CRC_ERROR;
+        __atomic_store_n(&port->stats.crc_errors, port->stats.crc_errors + 1, __ATOMIC_RELAXED);
+        event_log_write(EVENT_CRC_ERROR, port->index, address, 0, 0);
     }
     
-    // Send 32 bytes of data
-    for (int i = 0; i < 32; i++) {
-        n64_send_byte(response_data[i]);
-    }
-    
-    // Send CRC
-    n64_send_byte(crc);
-    n64_send_stop_bit();
+    n64_send_response(port->index, response, sizeof(response));
 }
 
-void n64_handle_write_command(void) {
-    // Receive 2-byte address with checksum
-    uint16_t address_with_checksum = (n64_receive_byte() << 8) | n64_receive_byte();
+static void __not_in_flash_func(n64_handle_write_command)(n64_port_t* port, const uint8_t* frame) {
+    // 2-byte address with checksum follows the command byte
+    uint16_t address_with_checksum = (frame[1] << 8) | frame[2];
     uint16_t address = address_with_checksum & 0xFFE0;
     uint8_t received_checksum = address_with_checksum & 0x1F;
     uint8_t calculated_checksum = calculate_address_checksum(address);
     
-    // Receive 32 bytes of data
-    uint8_t write_data[32];
-    for (int i = 0; i < 32; i++) {
-        write_data[i] = n64_receive_byte();
-    }
+    // 32 bytes of data follow the address
+    const uint8_t* write_data = &frame[3];
     
     uint8_t crc = calculate_crc(write_data, 32);
     
     if (received_checksum == calculated_checksum) {
-        // Write to controller pak
-        controller_pak_write(address, write_data, 32);
+        // Write to this port's controller pak; a write that couldn't be stored
+        // gets a bad CRC so the console retries or reports it
+        if (!controller_pak_write(port->index, address, write_data, 32)) {
+            crc ^= 0xFF;
+        }
     } else {
-        controller_info.status |= N64_STATUS_CRC_ERROR;
+        port->info.status |= N64_STATUS_CRC_ERROR;
+        __atomic_store_n(&port->stats.crc_errors, port->stats.crc_errors + 1, __ATOMIC_RELAXED);
+        event_log_write(EVENT_CRC_ERROR, port->index, address, 0, 0);
     }
     
     // Apply pak removed flag to CRC if needed
-    if (controller_info.status & N64_STATUS_PAK_REMOVED) {
+    if (port->info.status & N64_STATUS_PAK_REMOVED) {
         crc ^= 0xFF;
     }
     
     // Send CRC response
-    n64_send_byte(crc);
-    n64_send_stop_bit();
+    n64_send_response(port->index, &crc, N64_WRITE_RESPONSE_LENGTH);
 }
 
-void n64_handle_command(uint8_t command) {
+bool __not_in_flash_func(n64_handle_command)(uint8_t index, const uint8_t* frame, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    
+    n64_port_t* port = &ports[index];
+    uint8_t command = frame[0];
+    
+    // Truncated or overlong frame - don't answer with garbage
+    if (length != joybus_command_length(command)) {
+        return false;
+    }
+    
     switch (command) {
         case N64_CMD_INFO:
-            n64_handle_info_command();
+            n64_handle_info_command(port);
             break;
             
         case N64_CMD_POLL:
-            n64_handle_poll_command();
+            n64_handle_poll_command(port);
             break;
             
         case N64_CMD_READ:
-            n64_handle_read_command();
+            n64_handle_read_command(port, frame);
             break;
             
         case N64_CMD_WRITE:
-            n64_handle_write_command();
+            n64_handle_write_command(port, frame);
             break;
             
         case N64_CMD_RESET:
-            n64_protocol_reset();
-            n64_handle_info_command(); // Send info after reset
+            n64_protocol_reset(index);
+            n64_handle_info_command(port); // Send info after reset
             break;
             
         default:
             // Unknown command - send info as default
-            n64_handle_info_command();
+            n64_handle_info_command(port);
             break;
     }
+    
+    return true;
 }
 
-void n64_protocol_task(void) {
-    // Set pin as input to listen for commands
-    gpio_set_dir(N64_DATA_PIN, GPIO_IN);
-    gpio_pull_up(N64_DATA_PIN);
+// Called once on the core that runs n64_protocol_task()
+void n64_protocol_core_init(void) {
+    // A disabled interrupt becoming pending still wakes this core from WFE.
+    // SLEEPDEEP lets the clocks be gated while both cores sleep; the gating is
+    // set up by the power module and is a no-op otherwise.
+    scb_hw->scr |= M0PLUS_SCR_SEVONPEND_BITS | M0PLUS_SCR_SLEEPDEEP_BITS;
     
-    // Wait for falling edge (start of command)
-    while (gpio_get(N64_DATA_PIN));
+    // Free-running cycle counter for reply latency (no interrupt)
+    systick_hw->rvr = N64_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+void n64_protocol_get_stats(uint8_t index, n64_protocol_stats_t* out) {
+    const uint32_t* stats = (const uint32_t*)&ports[index].stats;
+    uint32_t* words = (uint32_t*)out;
+    
+    // Word by word: every field is a single aligned store on core 1
+    for (size_t i = 0; i < sizeof(n64_protocol_stats_t) / sizeof(uint32_t); i++) {
+        words[i] = __atomic_load_n(&stats[i], __ATOMIC_RELAXED);
+    }
+}
+
+void n64_protocol_get_latency(n64_command_class_t command_class, n64_latency_stats_t* out) {
+    const uint32_t* stats = (const uint32_t*)&latency_stats[command_class];
+    uint32_t* words = (uint32_t*)out;
+    
+    for (size_t i = 0; i < sizeof(n64_latency_stats_t) / sizeof(uint32_t); i++) {
+        words[i] = __atomic_load_n(&stats[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Called from core 0: find receivers that can no longer finish a frame and
+// have core 1 restart them. A noise burst longer than any frame fills the RX
+// DMA buffer and then the FIFO, and the state machine stalls on autopush
+// before it can flag the frame. Nothing else ever fills the FIFO.
+//
+// Ports with a request still pending are skipped, and the stall flags are read
+// only after that check: core 1 clears a port's flag before its request, so a
+// flag seen here is never one core 1 has already dealt with.
+void n64_protocol_watchdog(void) {
+    uint32_t pending = 0;
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        if (__atomic_load_n(&ports[i].resync_requested, __ATOMIC_ACQUIRE)) {
+            pending |= 1u << i;
+        }
+    }
     
-    // Receive command byte
-    uint8_t command = n64_receive_byte();
+    uint32_t stalled = (N64_PIO->fdebug >> PIO_FDEBUG_RXSTALL_LSB) & N64_PORT_IRQ_MASK & ~pending;
+    if (!stalled) {
+        return;
+    }
     
-    // Switch to output mode for response
-    gpio_set_dir(N64_DATA_PIN, GPIO_OUT);
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        if (stalled & (1u << i)) {
+            __atomic_store_n(&ports[i].resync_requested, true, __ATOMIC_RELEASE);
+        }
+    }
+    __sev();
+}
+
+// Called from core 0: zero every counter and histogram. Core 1 does the
+// clearing between frames (the SEV wakes it), so no update is torn.
+void n64_protocol_reset_stats(void) {
+    __atomic_store_n(&stats_reset_requested, true, __ATOMIC_RELEASE);
+    __sev();
+}
+
+static n64_command_class_t __not_in_flash_func(n64_command_class)(uint8_t command) {
+    switch (command) {
+        case N64_CMD_INFO:  return N64_COMMAND_CLASS_INFO;
+        case N64_CMD_POLL:  return N64_COMMAND_CLASS_POLL;
+        case N64_CMD_READ:  return N64_COMMAND_CLASS_READ;
+        case N64_CMD_WRITE: return N64_COMMAND_CLASS_WRITE;
+        case N64_CMD_RESET: return N64_COMMAND_CLASS_RESET;
+        default:            return N64_COMMAND_CLASS_OTHER;
+    }
+}
+
+// Core 1 side of n64_protocol_reset_stats()
+static void __not_in_flash_func(n64_stats_apply_reset)(void) {
+    if (!__atomic_load_n(&stats_reset_requested, __ATOMIC_ACQUIRE)) {
+        return;
+    }
     
-    // Small delay before response
-    busy_wait_us(1);
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        memset(&ports[i].stats, 0, sizeof(ports[i].stats));
+    }
+    memset(latency_stats, 0, sizeof(latency_stats));
+    __atomic_store_n(&stats_reset_requested, false, __ATOMIC_RELEASE);
+}
+
+// Called from core 0 once core 1 is parked for flash work, and again just
+// before it is let go. Core 1 wakes up to the frames that arrived in between
+// long after their stop bit, so they are stamped with when the park began
+// (core 0 can't see more exactly when they came) and n64_port_service() drops
+// those now past the reply deadline.
+void n64_protocol_park_begin(void) {
+    park_start_us = time_us_32();
+    park_flagged = (N64_PIO->irq >> n64_port_FRAME_IRQ) & N64_PORT_IRQ_MASK;
+}
+
+void n64_protocol_park_end(void) {
+    uint32_t flagged = ((N64_PIO->irq >> n64_port_FRAME_IRQ) & N64_PORT_IRQ_MASK) & ~park_flagged;
+    
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        if (flagged & (1u << i)) {
+            ports[i].parked_frame_us = park_start_us;
+            __atomic_store_n(&ports[i].parked_frames, ports[i].parked_frames + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// Core 1 side of n64_protocol_watchdog()
+static void __not_in_flash_func(n64_port_check_resync)(void) {
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        n64_port_t* port = &ports[i];
+        if (!__atomic_load_n(&port->resync_requested, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        
+        // Only restart a receiver that is still stalled, never one that is
+        // taking a good frame
+        if (N64_PIO->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + port->index))) {
+            n64_port_resync(port);
+            __atomic_store_n(&port->stats.resyncs, port->stats.resyncs + 1, __ATOMIC_RELAXED);
+            event_log_write(EVENT_RESYNC, port->index, 0, 0, 0);
+        }
+        __atomic_store_n(&port->resync_requested, false, __ATOMIC_RELEASE);
+    }
+}
+
+// Timestamp an answered frame and add its reply latency to the histograms.
+// Runs after the reply is on its way. The console stop bit ended
+// n64_port_IDLE_US before the state machine flagged the frame (wake_us); from
+// there SysTick times the reply handover, and the state machine takes
+// N64_REPLY_SETUP_NS more to pull the line low.
+static void __not_in_flash_func(n64_port_measure)(n64_port_t* port, size_t length, uint32_t wake_us, uint32_t wake_cycles) {
+    uint8_t command = port->rx_frame[0];
+    
+    uint32_t cycles = (wake_cycles - port->reply_cycles) & N64_SYSTICK_MASK;
+    if (cycles > (1u << 22)) {
+        cycles = 1u << 22;              // Keeps the conversion in 32 bits
+    }
+    uint32_t latency_ns = n64_port_IDLE_US * 1000 + N64_REPLY_SETUP_NS +
+                          cycles * 1000 / (SYS_CLOCK_KHZ / 1000);
+    
+    n64_latency_stats_t* stats = &latency_stats[n64_command_class(command)];
+    uint32_t bin = latency_ns / N64_LATENCY_BIN_NS;
+    if (bin >= N64_LATENCY_BINS) {
+        bin = N64_LATENCY_BINS - 1;
+    }
+    __atomic_store_n(&stats->histogram[bin], stats->histogram[bin] + 1, __ATOMIC_RELAXED);
+    if (stats->count == 0 || latency_ns < stats->min_ns) {
+        __atomic_store_n(&stats->min_ns, latency_ns, __ATOMIC_RELAXED);
+    }
+    if (latency_ns > stats->max_ns) {
+        __atomic_store_n(&stats->max_ns, latency_ns, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stats->count, stats->count + 1, __ATOMIC_RELAXED);
+    
+    // Frame and reply edges, from the fixed bit rate on both sides
+    uint32_t stop_end_us = wake_us - n64_port_IDLE_US;
+    uint32_t frame_start_us = stop_end_us - N64_STOP_CONSOLE_LOW_US - length * 8 * N64_BIT_PERIOD_US;
+    uint32_t reply_start_us = stop_end_us + latency_ns / 1000;
+    uint32_t reply_end_us = reply_start_us + port->reply_bits * N64_BIT_PERIOD_US +
+                            N64_STOP_CONTROLLER_LOW_US + N64_STOP_CONTROLLER_HIGH_US;
+    
+    n64_protocol_stats_t* port_stats = &port->stats;
+    __atomic_store_n(&port_stats->last_command, command, __ATOMIC_RELAXED);
+    __atomic_store_n(&port_stats->frame_start_us, frame_start_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&port_stats->reply_start_us, reply_start_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&port_stats->reply_end_us, reply_end_us, __ATOMIC_RELAXED);
+    
+    #if !EVENT_LOG_POLLS
+    if (command == N64_CMD_POLL) {
+        return;
+    }
+    #endif
+    
+    event_log_write(EVENT_COMMAND, port->index, command, length, frame_start_us);
+    event_log_write(EVENT_REPLY, port->index, command, reply_start_us, reply_end_us);
+}
+
+// Answer the frame a port has just received. wake_us and wake_cycles are
+// when core 1 saw the frame flag, in timer microseconds and SysTick cycles.
+static void __not_in_flash_func(n64_port_service)(n64_port_t* port, uint32_t wake_us, uint32_t wake_cycles) {
+    // Clear the flag first, then the NVIC pending bit, so the next frame is
+    // a fresh pending transition and generates a new event (another port
+    // still flagged keeps the line pending)
+    pio_interrupt_clear(N64_PIO, n64_port_FRAME_IRQ + port->index);
+    irq_clear(N64_PIO_IRQ);
+    
+    // DMA has already drained the FIFO, the remaining count gives the length.
+    // Bytes left over in the FIFO mean the frame overran the buffer, and the
+    // length check below drops it.
+    size_t length = N64_MAX_FRAME_LENGTH - dma_channel_hw_addr(port->rx_dma_chan)->transfer_count;
+    if (!pio_sm_is_rx_fifo_empty(N64_PIO, port->index)) {
+        length = N64_MAX_FRAME_LENGTH + 1;
+    }
+    
+    // The console stop bit ended n64_port_IDLE_US before core 1 woke, unless
+    // the frame came while core 1 was parked. Serving other ports first adds
+    // to its age as well. Past the deadline the console has stopped waiting,
+    // and a reply could run into its next command.
+    uint32_t frame_end_us = wake_us - n64_port_IDLE_US;
+    uint32_t parked = __atomic_load_n(&port->parked_frames, __ATOMIC_ACQUIRE);
+    if (parked != port->parked_frames_seen) {
+        port->parked_frames_seen = parked;
+        frame_end_us = port->parked_frame_us;
+    }
+    uint32_t age_us = time_us_32() - frame_end_us;
+    bool late = age_us > N64_REPLY_DEADLINE_US;
+    
+    // Ready for the next frame; the state machine waits for our reply first
+    n64_rx_arm(port);
     
     // Handle the command
-    n64_handle_command(command);
+    bool handled = !late && n64_handle_command(port->index, port->rx_frame, length);
+    if (!handled) {
+        n64_rx_release(port);
+    } else {
+        uint32_t now = time_us_32();
+        if (first_reply_us == 0) {
+            __atomic_store_n(&first_reply_us, now, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&last_reply_us, now, __ATOMIC_RELAXED);
+    }
+    
+    // Bookkeeping once the reply is on its way
+    n64_protocol_stats_t* stats = &port->stats;
+    if (!handled) {
+        __atomic_store_n(&stats->frames_dropped, stats->frames_dropped + 1, __ATOMIC_RELAXED);
+        event_log_write(EVENT_FRAME_DROPPED, port->index, (length > 0) ? port->rx_frame[0] : 0xFFFF, length,
+                        late ? age_us : 0);
+    } else {
+        n64_port_measure(port, length, wake_us, wake_cycles);
+    }
+    __atomic_store_n(&stats->frames_received, stats->frames_received + 1, __ATOMIC_RELAXED);
+    
+    if (length > 0) {
+        n64_record_frame(port, port->rx_frame[0]);
+    }
+}
+
+void __not_in_flash_func(n64_protocol_task)(void) {
+    // Sleep until a port flags a complete frame. The receiver holds the frame
+    // in DMA, so waking late costs reply latency, never bits; WFE wakes within
+    // a few cycles of the flag going up. Other events (SEV from core 0, the
+    // lockout interrupt) just mean another check.
+    uint32_t pending;
+    while (!(pending = (N64_PIO->irq >> n64_port_FRAME_IRQ) & N64_PORT_IRQ_MASK)) {
+        n64_stats_apply_reset();
+        n64_port_check_resync();
+        __wfe();
+    }
+    uint32_t wake_cycles = systick_hw->cvr;
+    uint32_t wake_us = time_us_32();
     
-    // Return to idle state
-    gpio_put(N64_DATA_PIN, 1);
-} 
\ No newline at end of file
+    // The console addresses the ports one after another, so normally only one
+    // is pending. Each port's state machine holds its line until answered, so
+    // serving them in turn never loses a frame.
+    for (uint8_t i = 0; i < N64_PORT_COUNT; i++) {
+        if (pending & (1u << i)) {
+            n64_port_service(&ports[i], wake_us, wake_cycles);
+        }
+    }
+}
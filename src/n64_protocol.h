@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
 
 // N64 Commands
 #define N64_CMD_INFO    0x00
@@ -11,6 +13,21 @@
 #define N64_CMD_WRITE   0x03
 #define N64_CMD_RESET   0xFF
 
+// Command frame lengths (command byte included)
+#define N64_CMD_INFO_LENGTH   1
+#define N64_CMD_POLL_LENGTH   1
+#define N64_CMD_READ_LENGTH   3     // Command + 2-byte address
+#define N64_CMD_WRITE_LENGTH  35    // Command + 2-byte address + 32 data bytes
+#define N64_CMD_RESET_LENGTH  1
+#define N64_MAX_FRAME_LENGTH  N64_CMD_WRITE_LENGTH
+
+// Response lengths (stop bit not included)
+#define N64_INFO_RESPONSE_LENGTH   3
+#define N64_POLL_RESPONSE_LENGTH   4
+#define N64_READ_RESPONSE_LENGTH   33    // 32 data bytes + CRC
+#define N64_WRITE_RESPONSE_LENGTH  1     // CRC
+#define N64_MAX_RESPONSE_LENGTH    N64_READ_RESPONSE_LENGTH
+
 // Controller response structure for poll command
 typedef struct {
     uint16_t buttons;    // Button state (14 bits used)
@@ -18,6 +35,21 @@ typedef struct {
     int8_t stick_y;      // Y-axis position (-128 to 127)
 } n64_controller_state_t;
 
+// Controller state packed into one 32-bit word in on-wire order
+// (buttons MSB first, stick X, stick Y). A single aligned word is read and
+// written in one bus access, so it can be handed between cores without a lock.
+static inline uint32_t n64_state_pack(const n64_controller_state_t* state) {
+    return ((uint32_t)state->buttons << 16) |
+           ((uint32_t)(uint8_t)state->stick_x << 8) |
+           (uint32_t)(uint8_t)state->stick_y;
+}
+
+static inline void n64_state_unpack(uint32_t word, n64_controller_state_t* state) {
+    state->buttons = (uint16_t)(word >> 16);
+    state->stick_x = (int8_t)(word >> 8);
+    state->stick_y = (int8_t)word;
+}
+
 // Controller info response
 typedef struct {
     uint8_t id_high;     // Controller ID high byte (0x05)
@@ -25,17 +57,68 @@ typedef struct {
     uint8_t status;      // Status byte
 } n64_controller_info_t;
 
-// Function prototypes
+// Bus health counters and the last transaction, kept per port. Times are
+// time_us_32() values; frame start and reply end are derived from the frame
+// lengths at the fixed Joybus bit rate.
+typedef struct {
+    uint32_t frames_received;   // Complete frames seen by the receiver
+    uint32_t frames_dropped;    // Frames not answered (bad length, truncated or past the reply deadline)
+    uint32_t crc_errors;        // READ/WRITE address checksum failures (N64_STATUS_CRC_ERROR set)
+    uint32_t missed_polls;      // Polls the learned poll period says should have arrived but didn't
+    uint32_t resyncs;           // Receiver restarts after it got wedged (overlong noise burst)
+    uint32_t last_command;
+    uint32_t frame_start_us;    // First edge of the last answered frame
+    uint32_t reply_start_us;    // First edge of its reply
+    uint32_t reply_end_us;      // End of the reply stop bit
+} n64_protocol_stats_t;
+
+// Reply latency per command: from the end of the console stop bit to the
+// first edge of the reply, in N64_LATENCY_BIN_NS bins (the last bin also
+// collects anything slower)
+typedef enum {
+    N64_COMMAND_CLASS_INFO,
+    N64_COMMAND_CLASS_POLL,
+    N64_COMMAND_CLASS_READ,
+    N64_COMMAND_CLASS_WRITE,
+    N64_COMMAND_CLASS_RESET,
+    N64_COMMAND_CLASS_OTHER,
+    N64_COMMAND_CLASS_COUNT
+} n64_command_class_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t max_ns;
+    uint32_t histogram[N64_LATENCY_BINS];
+} n64_latency_stats_t;
+
+// Called on core 1 when a POLL arrives on a port to produce a fresh packed
+// state word (see n64_state_pack). Has to return within a couple of microseconds.
+typedef uint32_t (*n64_poll_sampler_t)(uint8_t port);
+
+// Function prototypes (ports are numbered 0 to N64_PORT_COUNT - 1)
 bool n64_protocol_init(void);
+void n64_protocol_core_init(void);
 void n64_protocol_task(void);
-void n64_protocol_update_state(const n64_controller_state_t* state);
-void n64_protocol_reset(void);
+void n64_protocol_get_stats(uint8_t port, n64_protocol_stats_t* stats);
+void n64_protocol_get_latency(n64_command_class_t command_class, n64_latency_stats_t* stats);
+void n64_protocol_reset_stats(void);
+void n64_protocol_watchdog(void);
+void n64_protocol_update_state(uint8_t port, const n64_controller_state_t* state);
+void n64_protocol_get_state(uint8_t port, n64_controller_state_t* state);
+void n64_protocol_set_poll_sampler(n64_poll_sampler_t sampler);
+void n64_protocol_reset(uint8_t port);
+bool n64_protocol_idle_window(uint32_t duration_us);
+void n64_protocol_park_begin(void);
+void n64_protocol_park_end(void);
+uint32_t n64_protocol_first_reply_us(void);
+uint32_t n64_protocol_last_reply_us(void);
+uint32_t n64_protocol_last_frame_us(void);
+unsigned int n64_protocol_port_pin(uint8_t port);
 
 // Internal functions
-void n64_send_byte(uint8_t data);
-void n64_send_stop_bit(void);
-uint8_t n64_receive_byte(void);
-void n64_handle_command(uint8_t command);
+void n64_send_response(uint8_t port, const uint8_t* data, size_t length);
+bool n64_handle_command(uint8_t port, const uint8_t* frame, size_t length);
 
 // Status bits
 #define N64_STATUS_CRC_ERROR      0x04
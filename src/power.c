@@ -0,0 +1,156 @@
+#include "power.h"
+#include "config.h"
+#include "n64_protocol.h"
+#include "controller_pak.h"
+#include "status_led.h"
+#include "event_log.h"
+#include "stats_console.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
+
+// Clocks left running while both cores sleep: the Joybus PIO and its DMA, the
+// encoder PIO (so no stick movement is missed), GPIO edge detection, the timer
+// and everything needed to get back out. Gated: UART, USB, SPI, I2C, ADC, PWM,
+// RTC, ROM and the like. clk_sys itself keeps its frequency, the PIO bit
+// timing depends on it.
+#define POWER_SLEEP_EN0 (CLOCKS_SLEEP_EN0_CLK_SYS_CLOCKS_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_BUSCTRL_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_BUSFABRIC_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_VREG_AND_CHIP_RESET_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_PIO0_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_PIO1_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_PLL_SYS_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_PSM_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_RESETS_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_SIO_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_SRAM0_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_SRAM1_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_SRAM2_BITS | \
+                         CLOCKS_SLEEP_EN0_CLK_SYS_SRAM3_BITS)
+#define POWER_SLEEP_EN1 (CLOCKS_SLEEP_EN1_CLK_SYS_SRAM4_BITS | \
+                         CLOCKS_SLEEP_EN1_CLK_SYS_SRAM5_BITS | \
+                         CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | \
+                         CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS | \
+                         CLOCKS_SLEEP_EN1_CLK_SYS_XIP_BITS)
+
+// Written by the GPIO interrupt while power_sleep() polls them
+static volatile bool woken = false;         // Set by the GPIO interrupt
+static volatile uint32_t wake_edge_us = 0;  // When the waking edge was seen
+
+static uint32_t awake_since_us = 0; // Last wake, keeps the board up for a while after it
+static bool awaiting_reply = false; // Wake latency not measured yet
+static power_stats_t stats = {0};
+
+static void power_gpio_irq(uint gpio, uint32_t events) {
+    // One-shot: stop listening on every data line
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        gpio_set_irq_enabled(n64_protocol_port_pin(port), GPIO_IRQ_EDGE_FALL, false);
+    }
+    
+    if (!woken) {
+        wake_edge_us = time_us_32();
+        woken = true;
+    }
+}
+
+void power_init(void) {
+    awake_since_us = time_us_32();
+}
+
+// Sleep until a falling edge on any data line. Core 1 keeps sleeping on its
+// own WFE and answers the frame as soon as the PIO has it.
+static void power_sleep(void) {
+    stats.sleeps++;
+    event_log_write(EVENT_SLEEP, 0, 0, stats.sleeps, 0);
+    
+    // The UART clock is about to be gated
+    event_log_flush();
+    
+    // No heartbeat while asleep (its alarm would wake us every step)
+    status_led_set_background(NULL);
+    
+    woken = false;
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        uint pin = n64_protocol_port_pin(port);
+        gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_FALL);
+        gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_FALL, true, power_gpio_irq);
+    }
+    
+    // Gate clocks while both cores sleep (core 1 sets SLEEPDEEP in
+    // n64_protocol_core_init, and runs normally whenever it is awake)
+    uint32_t sleep_en0 = clocks_hw->sleep_en0;
+    uint32_t sleep_en1 = clocks_hw->sleep_en1;
+    clocks_hw->sleep_en0 = POWER_SLEEP_EN0;
+    clocks_hw->sleep_en1 = POWER_SLEEP_EN1;
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+    
+    // The default alarm pool also runs the USB stdio background task every
+    // millisecond. With no host there is nothing for it to do, so its
+    // interrupt mustn't wake the core; it catches up after the wake.
+    uint timer_irq = TIMER_IRQ_0 + alarm_pool_hardware_alarm_num(alarm_pool_get_default());
+    irq_set_enabled(timer_irq, false);
+    
+    // WFI with interrupts masked still wakes on a pending interrupt, so an
+    // edge between the check and the WFI can't be missed
+    uint32_t interrupts = save_and_disable_interrupts();
+    while (!woken) {
+        __wfi();
+        restore_interrupts(interrupts);     // Let the handler run
+        interrupts = save_and_disable_interrupts();
+    }
+    restore_interrupts(interrupts);
+    irq_set_enabled(timer_irq, true);
+    
+    scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+    clocks_hw->sleep_en0 = sleep_en0;
+    clocks_hw->sleep_en1 = sleep_en1;
+    
+    awake_since_us = time_us_32();
+    awaiting_reply = true;
+    status_led_set_background(&STATUS_LED_HEARTBEAT);
+}
+
+// Called from the core 0 main loop
+void power_task(void) {
+    uint32_t now = time_us_32();
+    
+    // Wake latency: from the edge that woke us to the first reply core 1 sent
+    if (awaiting_reply) {
+        uint32_t reply_us = n64_protocol_last_reply_us();
+        if ((int32_t)(reply_us - wake_edge_us) >= 0) {
+            uint32_t latency = reply_us - wake_edge_us;
+            stats.last_wake_latency_us = latency;
+            if (latency > stats.max_wake_latency_us) {
+                stats.max_wake_latency_us = latency;
+            }
+            event_log_write(EVENT_WAKE, 0, 0, latency, 0);
+            awaiting_reply = false;
+        } else if (now - wake_edge_us >= N64_CONSOLE_IDLE_US) {
+            awaiting_reply = false;     // Noise on the line, nothing to answer
+        }
+    }
+    
+    // Console quiet long enough (counting from the last wake too), nothing
+    // left to save, and not enumerated by a USB host that gating clk_usb and
+    // USBCTRL would cut off
+    uint32_t quiet_us = now - n64_protocol_last_frame_us();
+    if (now - awake_since_us < quiet_us) {
+        quiet_us = now - awake_since_us;
+    }
+    if (quiet_us < POWER_IDLE_MS * 1000u || controller_pak_save_pending() || stats_console_usb_mounted()) {
+        return;
+    }
+    
+    power_sleep();
+}
+
+void power_get_stats(power_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,23 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Low-power idle: when the console stops talking (off or unplugged), core 0
+// gates the clocks the Joybus path doesn't need and sleeps until a data line
+// moves. Core 1 and the PIO keep running, so the frame that wakes the board
+// is still answered.
+
+typedef struct {
+    uint32_t sleeps;                // Times the board went to sleep
+    uint32_t last_wake_latency_us;  // Data line edge to the first reply, last wake
+    uint32_t max_wake_latency_us;   // Worst wake seen
+} power_stats_t;
+
+// Function prototypes
+void power_init(void);
+void power_task(void);
+void power_get_stats(power_stats_t* stats);
+
+#endif // POWER_H
@@ -0,0 +1,104 @@
+#include "stats_console.h"
+#include "config.h"
+#include "n64_protocol.h"
+#include "power.h"
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+
+#if STATS_CONSOLE_ENABLE
+
+static const char* const command_class_names[N64_COMMAND_CLASS_COUNT] = {
+    [N64_COMMAND_CLASS_INFO] = "info",
+    [N64_COMMAND_CLASS_POLL] = "poll",
+    [N64_COMMAND_CLASS_READ] = "read",
+    [N64_COMMAND_CLASS_WRITE] = "write",
+    [N64_COMMAND_CLASS_RESET] = "reset",
+    [N64_COMMAND_CLASS_OTHER] = "other",
+};
+
+void stats_console_init(void) {
+    stdio_usb_init();
+}
+
+// Enumerated by a host, whether or not a terminal has the port open
+// (stdio_usb_connected() only reports the latter)
+bool stats_console_usb_mounted(void) {
+    return tud_mounted();
+}
+
+// One line per port and per command class, key=value pairs so the report is
+// easy to parse. Histogram bins are N64_LATENCY_BIN_NS wide starting at 0.
+static void stats_console_report(void) {
+    printf("time_us=%lu bin_ns=%u bins=%u\n", (unsigned long)time_us_32(),
+           N64_LATENCY_BIN_NS, N64_LATENCY_BINS);
+    
+    for (uint8_t port = 0; port < N64_PORT_COUNT; port++) {
+        n64_protocol_stats_t stats;
+        n64_protocol_get_stats(port, &stats);
+        printf("port=%u frames=%lu dropped=%lu crc_errors=%lu missed_polls=%lu resyncs=%lu "
+               "last_cmd=0x%02lX frame_start_us=%lu reply_start_us=%lu reply_end_us=%lu\n",
+               port + 1,
+               (unsigned long)stats.frames_received,
+               (unsigned long)stats.frames_dropped,
+               (unsigned long)stats.crc_errors,
+               (unsigned long)stats.missed_polls,
+               (unsigned long)stats.resyncs,
+               (unsigned long)stats.last_command,
+               (unsigned long)stats.frame_start_us,
+               (unsigned long)stats.reply_start_us,
+               (unsigned long)stats.reply_end_us);
+    }
+    
+    for (int i = 0; i < N64_COMMAND_CLASS_COUNT; i++) {
+        n64_latency_stats_t latency;
+        n64_protocol_get_latency((n64_command_class_t)i, &latency);
+        printf("latency=%s count=%lu min_ns=%lu max_ns=%lu histogram=",
+               command_class_names[i],
+               (unsigned long)latency.count,
+               (unsigned long)latency.min_ns,
+               (unsigned long)latency.max_ns);
+        for (int bin = 0; bin < N64_LATENCY_BINS; bin++) {
+            printf(bin ? ",%lu" : "%lu", (unsigned long)latency.histogram[bin]);
+        }
+        printf("\n");
+    }
+    
+    power_stats_t power;
+    power_get_stats(&power);
+    printf("sleeps=%lu last_wake_latency_us=%lu max_wake_latency_us=%lu\n",
+           (unsigned long)power.sleeps,
+           (unsigned long)power.last_wake_latency_us,
+           (unsigned long)power.max_wake_latency_us);
+    printf("end\n");
+}
+
+// Called from the core 0 main loop. Only a request makes it write anything
+// (stdio can wait on the host), never the Joybus path.
+void stats_console_task(void) {
+    int c = getchar_timeout_us(0);
+    switch (c) {
+        case PICO_ERROR_TIMEOUT:
+            break;
+            
+        case 's':
+            stats_console_report();
+            break;
+            
+        case 'r':
+            n64_protocol_reset_stats();
+            printf("reset\n");
+            break;
+            
+        case '\r':
+        case '\n':
+            break;
+            
+        default:
+            printf("s: report, r: reset\n");
+            break;
+    }
+}
+
+#endif // STATS_CONSOLE_ENABLE
@@ -0,0 +1,25 @@
+#ifndef STATS_CONSOLE_H
+#define STATS_CONSOLE_H
+
+#include <stdbool.h>
+#include "config.h"
+
+// Joybus statistics on demand over USB serial. Send 's' for a report of the
+// per-port counters, last transaction and per-command latency histograms,
+// 'r' to reset them. Nothing is written unless asked for.
+//
+// stats_console_usb_mounted() tells whether a USB host has enumerated the
+// board (terminal open or not); its clocks must then keep running.
+
+// Function prototypes
+#if STATS_CONSOLE_ENABLE
+void stats_console_init(void);
+void stats_console_task(void);
+bool stats_console_usb_mounted(void);
+#else
+static inline void stats_console_init(void) {}
+static inline void stats_console_task(void) {}
+static inline bool stats_console_usb_mounted(void) { return false; }
+#endif
+
+#endif // STATS_CONSOLE_H
@@ -0,0 +1,96 @@
+#include "status_led.h"
+#include "config.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+// Patterns run from a hardware alarm: the callback sets the LED for the
+// current step and reschedules itself, so nothing on the main loop ever waits
+// for the LED.
+
+#define STATUS_LED_PATTERN(name, do_repeat, ...) \
+    static const uint16_t name##_steps[] = { __VA_ARGS__ }; \
+    const status_led_pattern_t name = { name##_steps, sizeof(name##_steps) / sizeof(uint16_t), do_repeat }
+
+STATUS_LED_PATTERN(STATUS_LED_BOOT, false, 200, 200);
+STATUS_LED_PATTERN(STATUS_LED_READY, false, 100, 100, 100, 100);
+STATUS_LED_PATTERN(STATUS_LED_RESET, false, 100, 100, 100, 100, 100, 100);
+STATUS_LED_PATTERN(STATUS_LED_ERROR_PAK, false, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100);
+STATUS_LED_PATTERN(STATUS_LED_ERROR_PROTOCOL, false, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+                   100, 100, 100, 100, 100, 100, 100, 100, 100, 100);
+STATUS_LED_PATTERN(STATUS_LED_HEARTBEAT, true, 50, 950);
+STATUS_LED_PATTERN(STATUS_LED_FAILED, true, 250, 750);
+
+// Engine state, only touched on core 0 (thread context with the alarm
+// cancelled, or the alarm callback)
+static const status_led_pattern_t* current = NULL;
+static const status_led_pattern_t* background = NULL;
+static uint8_t step = 0;
+static alarm_id_t alarm = 0;
+
+// Light the LED for the current step and return how long it lasts, or 0 once
+// nothing is left to play
+static uint32_t status_led_apply(void) {
+    if (current && step >= current->count) {
+        step = 0;
+        if (!current->repeat) {
+            current = background;
+        }
+    }
+    
+    if (!current || current->count == 0) {
+        gpio_put(STATUS_LED_PIN, 0);
+        return 0;
+    }
+    
+    // Even steps are on, odd steps off
+    gpio_put(STATUS_LED_PIN, (step & 1) == 0);
+    return current->steps[step++];
+}
+
+static int64_t status_led_alarm(alarm_id_t id, void* user_data) {
+    uint32_t duration_ms = status_led_apply();
+    if (duration_ms == 0) {
+        alarm = 0;
+        return 0;
+    }
+    
+    // Negative: relative to when this alarm was due, so patterns don't drift
+    return -(int64_t)duration_ms * 1000;
+}
+
+// Switch to a pattern at its first step
+static void status_led_start(const status_led_pattern_t* pattern) {
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+        alarm = 0;
+    }
+    
+    current = pattern;
+    step = 0;
+    
+    uint32_t duration_ms = status_led_apply();
+    if (duration_ms > 0) {
+        alarm = add_alarm_in_ms(duration_ms, status_led_alarm, NULL, true);
+    }
+}
+
+void status_led_init(void) {
+    gpio_init(STATUS_LED_PIN);
+    gpio_set_dir(STATUS_LED_PIN, GPIO_OUT);
+    gpio_put(STATUS_LED_PIN, 0);
+}
+
+// Play a pattern now, interrupting whatever is showing
+void status_led_play(const status_led_pattern_t* pattern) {
+    status_led_start(pattern);
+}
+
+// Pattern shown whenever no one-shot pattern is playing
+void status_led_set_background(const status_led_pattern_t* pattern) {
+    background = pattern;
+    
+    // Take over right away unless a one-shot pattern is still playing
+    if (!current || current->repeat) {
+        status_led_start(pattern);
+    }
+}
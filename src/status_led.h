@@ -0,0 +1,29 @@
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// LED pattern: alternating on and off times in milliseconds, starting with on.
+// One-shot patterns play once and then hand back to the background pattern.
+typedef struct {
+    const uint16_t* steps;
+    uint8_t count;
+    bool repeat;
+} status_led_pattern_t;
+
+// Patterns
+extern const status_led_pattern_t STATUS_LED_BOOT;             // Power-on
+extern const status_led_pattern_t STATUS_LED_READY;            // Initialization complete
+extern const status_led_pattern_t STATUS_LED_RESET;            // L + R + Start recentering
+extern const status_led_pattern_t STATUS_LED_ERROR_PAK;        // Controller pak init failed
+extern const status_led_pattern_t STATUS_LED_ERROR_PROTOCOL;   // Joybus init failed
+extern const status_led_pattern_t STATUS_LED_HEARTBEAT;        // Normal operation (background)
+extern const status_led_pattern_t STATUS_LED_FAILED;           // Stopped after an error (background)
+
+// Function prototypes
+void status_led_init(void);
+void status_led_play(const status_led_pattern_t* pattern);
+void status_led_set_background(const status_led_pattern_t* pattern);
+
+#endif // STATUS_LED_H
@@ -0,0 +1,29 @@
+#include "stick.h"
+#include "pico/platform.h"
+
+// The tables are read on core 1 for every poll, keep them out of XIP flash
+#define STICK_LUT_SECTION __not_in_flash("stick_lut")
+#include "stick_lut.h"
+
+// Tables are indexed by magnitude and must fit the N64 range
+_Static_assert(STICK_LUT_GRID <= 127, "Stick grid must fit in int8_t");
+
+static inline int32_t stick_clamp_raw(int32_t raw) {
+    if (raw > STICK_LUT_RAW_MAX) return STICK_LUT_RAW_MAX;
+    if (raw < -STICK_LUT_RAW_MAX) return -STICK_LUT_RAW_MAX;
+    return raw;
+}
+
+// Map encoder counts (relative to center) to the reported stick position:
+// two calibration lookups and one response lookup, no branches on the profile
+void __not_in_flash_func(stick_map)(int32_t raw_x, int32_t raw_y, int8_t* x, int8_t* y) {
+    int32_t grid_x = stick_lut_x[stick_clamp_raw(raw_x) + STICK_LUT_RAW_MAX];
+    int32_t grid_y = stick_lut_y[stick_clamp_raw(raw_y) + STICK_LUT_RAW_MAX];
+    
+    // The response table covers one quadrant, the signs are put back after
+    const uint8_t* out = stick_lut_response[grid_x < 0 ? -grid_x : grid_x]
+                                           [grid_y < 0 ? -grid_y : grid_y];
+    
+    *x = grid_x < 0 ? -(int8_t)out[0] : (int8_t)out[0];
+    *y = grid_y < 0 ? -(int8_t)out[1] : (int8_t)out[1];
+}
@@ -0,0 +1,13 @@
+#ifndef STICK_H
+#define STICK_H
+
+#include <stdint.h>
+
+// Stick response: calibration, radial deadzone, curve and gate, all baked into
+// lookup tables at build time from a profile (tools/stick_profiles, selected
+// with the STICK_PROFILE CMake option)
+
+// Function prototypes
+void stick_map(int32_t raw_x, int32_t raw_y, int8_t* x, int8_t* y);
+
+#endif // STICK_H
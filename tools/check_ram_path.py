@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Check that the Joybus reply path never runs from or reads XIP flash.
+
+Disassembles the firmware, walks the call graph from the given root functions
+and fails if anything reachable lives in flash, or loads a flash address from
+its literal pool (const data or a function pointer). Calls through function
+pointers can't be followed, so their targets have to be listed as roots.
+
+Usage: check_ram_path.py OBJDUMP FIRMWARE.elf ROOTS [ALLOWED]
+
+ROOTS and ALLOWED are comma-separated function names. ALLOWED functions may
+read flash data on purpose (the controller pak image when
+CONTROLLER_PAK_XIP_READS is set); they still have to run from SRAM.
+"""
+
+import re
+import subprocess
+import sys
+
+FLASH_START = 0x10000000
+FLASH_END = 0x20000000  # XIP and its cache/no-allocate aliases
+
+HEADER = re.compile(r"^([0-9a-f]{8}) <([^>]+)>:$")
+BRANCH = re.compile(r"\tb[a-z.]*\s+[0-9a-f]+ <([^>+]+)(?:\+0x[0-9a-f]+)?>")
+WORD = re.compile(r"\t\.word\t0x([0-9a-f]{8})")
+VENEER = re.compile(r"^__(.+)_veneer$")
+
+
+def in_flash(address):
+    return FLASH_START <= address < FLASH_END
+
+
+def parse(objdump, elf):
+    """Map each symbol to its address, the functions it branches to and the
+    flash addresses in its literal pool."""
+    listing = subprocess.run([objdump, "-D", "--no-show-raw-insn", elf],
+                             check=True, capture_output=True, text=True).stdout
+    symbols = {}
+    name = None
+    for line in listing.splitlines():
+        header = HEADER.match(line)
+        if header:
+            name = header.group(2)
+            symbols.setdefault(name, {"address": int(header.group(1), 16),
+                                      "calls": set(), "flash_words": set()})
+            continue
+        if name is None:
+            continue
+        branch = BRANCH.search(line)
+        if branch and branch.group(1) != name:
+            symbols[name]["calls"].add(branch.group(1))
+        word = WORD.search(line)
+        if word and in_flash(int(word.group(1), 16)):
+            symbols[name]["flash_words"].add(int(word.group(1), 16))
+    return symbols
+
+
+def main():
+    if len(sys.argv) not in (4, 5):
+        sys.exit(__doc__)
+    objdump, elf = sys.argv[1], sys.argv[2]
+    roots = [r for r in sys.argv[3].split(",") if r]
+    allowed = set(a for a in sys.argv[4].split(",") if a) if len(sys.argv) == 5 else set()
+
+    symbols = parse(objdump, elf)
+    errors = []
+    parent = {}
+    pending = []
+    for root in roots:
+        if root not in symbols:
+            errors.append("root %s not found in %s" % (root, elf))
+            continue
+        parent[root] = None
+        pending.append(root)
+
+    def path(name):
+        chain = []
+        while name is not None:
+            chain.append(name)
+            name = parent[name]
+        return " <- ".join(chain)
+
+    while pending:
+        name = pending.pop()
+        symbol = symbols[name]
+        if in_flash(symbol["address"]):
+            errors.append("runs from flash (0x%08x): %s" % (symbol["address"], path(name)))
+            continue
+        if symbol["flash_words"] and name not in allowed:
+            words = ", ".join("0x%08x" % w for w in sorted(symbol["flash_words"]))
+            errors.append("loads flash address %s: %s" % (words, path(name)))
+
+        calls = set(symbol["calls"])
+        veneer = VENEER.match(name)
+        if veneer:
+            calls.add(veneer.group(1))
+        for callee in sorted(calls):
+            if callee in symbols and callee not in parent:
+                parent[callee] = name
+                pending.append(callee)
+
+    if errors:
+        for error in errors:
+            print("check_ram_path: " + error, file=sys.stderr)
+        sys.exit(1)
+    print("check_ram_path: %d functions on the reply path, all in SRAM" % len(parent))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Generate the Joybus checksum tables (joybus_tables.h).
+
+src/joybus.c computes the controller pak checksums with lookups instead of
+bit loops:
+
+  1. crc_table: the CRC-8 (polynomial 0x85, MSB first, initial value 0) of
+     every byte value, so the data CRC costs one lookup per byte.
+  2. address_checksum_high/low: the address checksum is an XOR of one
+     constant per set address bit (bits 15 down to 5), so it splits into a
+     lookup for bits 15-10 and one for bits 9-5.
+
+The tables are derived here from the polynomial and the per-bit constants,
+at build time, rather than pasted into the source.
+
+Usage: gen_joybus_tables.py OUTPUT.h
+"""
+
+import os
+import sys
+
+CRC_POLYNOMIAL = 0x85
+
+# Address checksum constant for each address bit, bit 15 first
+ADDRESS_BIT_CONSTANTS = [0x01, 0x1A, 0x0D, 0x1C, 0x0E, 0x07, 0x19, 0x16, 0x0B, 0x1F, 0x15]
+
+
+def crc_byte(value):
+    """Shift one byte through the polynomial eight times."""
+    crc = value
+    for _ in range(8):
+        crc = ((crc << 1) ^ CRC_POLYNOMIAL if crc & 0x80 else crc << 1) & 0xFF
+    return crc
+
+
+def address_checksum(address):
+    """Reference checksum of a 16-bit address (bits 4-0 ignored)."""
+    checksum = 0
+    for i, constant in enumerate(ADDRESS_BIT_CONSTANTS):
+        if address & (1 << (15 - i)):
+            checksum ^= constant
+    return checksum
+
+
+def format_array(values, per_line, indent="    "):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append(indent + ", ".join("0x%02X" % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    output_path = sys.argv[1]
+
+    crc_table = [crc_byte(value) for value in range(256)]
+    checksum_high = [address_checksum(bits << 10) for bits in range(64)]
+    checksum_low = [address_checksum(bits << 5) for bits in range(32)]
+
+    # The split is only valid because the checksum is linear in the address bits
+    for address in range(0, 0x10000, 0x20):
+        split = checksum_high[address >> 10] ^ checksum_low[(address >> 5) & 0x1F]
+        if split != address_checksum(address):
+            raise ValueError("address checksum split disagrees at 0x%04X" % address)
+
+    out = []
+    out.append("// Generated by tools/gen_joybus_tables.py - do not edit")
+    out.append("#ifndef JOYBUS_TABLES_H")
+    out.append("#define JOYBUS_TABLES_H")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("// Placement of the tables (joybus.c puts them in SRAM)")
+    out.append("#ifndef JOYBUS_TABLE_SECTION")
+    out.append("#define JOYBUS_TABLE_SECTION")
+    out.append("#endif")
+    out.append("")
+    out.append("// CRC-8 (polynomial 0x%02X, MSB first) of every byte value" % CRC_POLYNOMIAL)
+    out.append("static const uint8_t JOYBUS_TABLE_SECTION crc_table[256] = {")
+    out.append(format_array(crc_table, 8))
+    out.append("};")
+    out.append("")
+    out.append("// Address checksum of bits 15-10 and of bits 9-5")
+    out.append("static const uint8_t JOYBUS_TABLE_SECTION address_checksum_high[64] = {")
+    out.append(format_array(checksum_high, 8))
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t JOYBUS_TABLE_SECTION address_checksum_low[32] = {")
+    out.append(format_array(checksum_low, 8))
+    out.append("};")
+    out.append("")
+    out.append("#endif // JOYBUS_TABLES_H")
+
+    os.makedirs(os.path.dirname(os.path.abspath(output_path)), exist_ok=True)
+    with open(output_path, "w") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
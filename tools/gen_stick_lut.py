@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Generate the stick response tables (stick_lut.h) from a stick profile.
+
+The firmware maps encoder counts to the reported stick position in two
+lookups (see src/stick.c):
+
+  1. Per-axis calibration: raw count -> signed grid coordinate.
+  2. A quadrant-symmetric 2D table: (|grid x|, |grid y|) -> (|x|, |y|),
+     which applies the radial deadzone, response curve and gate.
+
+All of the floating point work happens here, at build time.
+
+Usage: gen_stick_lut.py PROFILE.json OUTPUT.h
+"""
+
+import json
+import math
+import os
+import sys
+
+GRID_LIMIT = 127
+
+
+def calibrate_axis(axis, raw_max, grid):
+    """Raw counts in [-raw_max, raw_max] -> grid coordinates in [-grid, grid]."""
+    center = axis.get("center", 0)
+    negative = axis["negative"] - center
+    positive = axis["positive"] - center
+    if negative >= 0 or positive <= 0:
+        raise ValueError("axis needs negative < center < positive")
+
+    table = []
+    for raw in range(-raw_max, raw_max + 1):
+        value = raw - center
+        norm = value / positive if value >= 0 else -value / negative
+        if axis.get("invert", False):
+            norm = -norm
+        norm = max(-1.0, min(1.0, norm))
+        table.append(int(round(norm * grid)))
+    return table
+
+
+def make_curve(curve):
+    kind = curve.get("type", "linear")
+    if kind == "linear":
+        return lambda r: r
+    if kind == "power":
+        exponent = curve["exponent"]
+        return lambda r: r ** exponent
+    if kind == "points":
+        points = sorted(curve["points"])
+        if points[0][0] != 0 or points[-1][0] != 1:
+            raise ValueError("curve points must span 0..1")
+
+        def piecewise(r):
+            for (x0, y0), (x1, y1) in zip(points, points[1:]):
+                if r <= x1:
+                    return y0 + (y1 - y0) * (r - x0) / (x1 - x0)
+            return points[-1][1]
+        return piecewise
+    raise ValueError("unknown curve type: %s" % kind)
+
+
+def octagon_radius(angle, diagonal):
+    """Distance from the center to an octagon with vertices at (1, 0) and
+    (diagonal, diagonal), along the direction angle (first quadrant)."""
+    if angle > math.pi / 4:
+        angle = math.pi / 2 - angle
+    ux, uy = math.cos(angle), math.sin(angle)
+    # Edge from (1, 0) to (d, d): points (1 + s (d - 1), s d)
+    ex, ey = diagonal - 1.0, diagonal
+    det = ux * ey - uy * ex
+    return ey / det
+
+
+def response_table(profile, grid):
+    deadzone = profile.get("deadzone", 0.0)
+    outer = profile.get("outer_deadzone", 1.0)
+    curve = make_curve(profile.get("curve", {"type": "linear"}))
+    gate = profile.get("gate", {"type": "square"})
+    output_max = profile.get("output_max", 127)
+    if not 0 <= deadzone < outer:
+        raise ValueError("deadzone must be below outer_deadzone")
+
+    table = []
+    for gx in range(grid + 1):
+        row = []
+        for gy in range(grid + 1):
+            x, y = gx / grid, gy / grid
+            radius = math.hypot(x, y)
+            if radius <= deadzone:
+                row.append((0, 0))
+                continue
+
+            # Radial deadzone, then the curve (corners beyond the unit
+            # circle keep growing linearly, which only matters for the
+            # square gate)
+            scaled = (radius - deadzone) / (outer - deadzone)
+            shaped = curve(min(scaled, 1.0)) * max(scaled, 1.0)
+            dx, dy = x / radius, y / radius
+
+            kind = gate["type"]
+            if kind == "square":
+                ox, oy = min(dx * shaped, 1.0), min(dy * shaped, 1.0)
+            elif kind == "circle":
+                shaped = min(shaped, 1.0)
+                ox, oy = dx * shaped, dy * shaped
+            elif kind == "octagon":
+                shaped = min(shaped, 1.0) * octagon_radius(math.atan2(y, x), gate["diagonal"])
+                ox, oy = dx * shaped, dy * shaped
+            else:
+                raise ValueError("unknown gate type: %s" % kind)
+
+            row.append((min(127, int(round(ox * output_max))),
+                        min(127, int(round(oy * output_max)))))
+        table.append(row)
+    return table
+
+
+def format_array(values, per_line, indent="    "):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append(indent + ", ".join("%d" % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    profile_path, output_path = sys.argv[1], sys.argv[2]
+    with open(profile_path) as f:
+        profile = json.load(f)
+
+    axes = (profile["x"], profile["y"])
+    full = max(max(abs(a["negative"] - a.get("center", 0)), abs(a["positive"] - a.get("center", 0)))
+               for a in axes)
+    grid = min(GRID_LIMIT, int(math.ceil(full)))
+    raw_max = int(math.ceil(full + max(abs(a.get("center", 0)) for a in axes)))
+
+    lut_x = calibrate_axis(profile["x"], raw_max, grid)
+    lut_y = calibrate_axis(profile["y"], raw_max, grid)
+    response = response_table(profile, grid)
+
+    out = []
+    out.append("// Generated by tools/gen_stick_lut.py from %s - do not edit"
+               % os.path.basename(profile_path))
+    if "description" in profile:
+        out.append("// %s" % profile["description"])
+    out.append("#ifndef STICK_LUT_H")
+    out.append("#define STICK_LUT_H")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("// Placement of the tables (stick.c puts them in SRAM)")
+    out.append("#ifndef STICK_LUT_SECTION")
+    out.append("#define STICK_LUT_SECTION")
+    out.append("#endif")
+    out.append("")
+    out.append("#define STICK_LUT_RAW_MAX %d  // Calibration input range [-RAW_MAX, RAW_MAX]" % raw_max)
+    out.append("#define STICK_LUT_GRID %d     // Response table covers [0, GRID] per axis" % grid)
+    out.append("")
+    out.append("// Raw count + RAW_MAX -> signed grid coordinate")
+    out.append("static const int8_t STICK_LUT_SECTION stick_lut_x[2 * STICK_LUT_RAW_MAX + 1] = {")
+    out.append(format_array(lut_x, 16))
+    out.append("};")
+    out.append("")
+    out.append("static const int8_t STICK_LUT_SECTION stick_lut_y[2 * STICK_LUT_RAW_MAX + 1] = {")
+    out.append(format_array(lut_y, 16))
+    out.append("};")
+    out.append("")
+    out.append("// (|grid x|, |grid y|) -> (|x|, |y|)")
+    out.append("static const uint8_t STICK_LUT_SECTION stick_lut_response[STICK_LUT_GRID + 1][STICK_LUT_GRID + 1][2] = {")
+    for row in response:
+        out.append("    {")
+        for i in range(0, len(row), 8):
+            out.append("        " + " ".join("{%d, %d}," % pair for pair in row[i:i + 8]))
+        out.append("    },")
+    out.append("};")
+    out.append("")
+    out.append("#endif // STICK_LUT_H")
+
+    with open(output_path, "w") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()